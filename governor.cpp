@@ -24,22 +24,54 @@ void governor_prepare(size_t numThreads)
     sGovernor->Prepare(numThreads);
 }
 
+extern "C"
+size_t governor_launch()
+{
+    return sGovernor->Launch();
+}
+
+extern "C"
+void governor_launched()
+{
+    sGovernor->EndLaunch();
+}
+
 extern "C"
 void governor_subscribe(size_t threadId)
 {
     sGovernor->Subscribe(threadId);
 }
 
+extern "C"
+void governor_subscribe_symmetric(size_t threadId, size_t symClass)
+{
+    sGovernor->Subscribe(threadId, symClass);
+}
+
 extern "C"
 void governor_unsubscribe()
 {
-    sGovernor->Unsubscribe();
+    Governor::Current()->Unsubscribe();
 }
 
 extern "C"
 void governor_control()
 {
-    sGovernor->ControlPoint();
+    Governor::Current()->ControlPoint();
+}
+
+extern "C"
+void governor_control_site(const char* file, int line, const char* func)
+{
+    Governor::Current()->ControlPoint(file, line, func);
+}
+
+extern "C"
+void governor_control_access(const char* file, int line, const char* func,
+    const void* addr, int isWrite)
+{
+    Governor::Current()->ControlPoint(file, line, func, addr,
+        isWrite ? ACCESS_WRITE : ACCESS_READ);
 }
 
 extern "C"
@@ -47,3 +79,53 @@ int governor_reset()
 {
     return sGovernor->Reset();
 }
+
+extern "C"
+void governor_register_strategy(const char* name,
+    const struct gov_strategy* strategy)
+{
+    sGovernor->RegisterStrategy(name, new CStrategy(*strategy));
+}
+
+// scheduling domains are governors other than the default one
+static Governor* ToGovernor(struct gov_domain* domain)
+{
+    return reinterpret_cast<Governor*>(domain);
+}
+
+extern "C"
+struct gov_domain* governor_domain_create(const char* name)
+{
+    return reinterpret_cast<struct gov_domain*>(Governor::CreateDomain(name));
+}
+
+extern "C"
+void governor_domain_destroy(struct gov_domain* domain)
+{
+    Governor::DestroyDomain(ToGovernor(domain));
+}
+
+extern "C"
+void governor_domain_prepare(struct gov_domain* domain, size_t numThreads)
+{
+    ToGovernor(domain)->Prepare(numThreads);
+}
+
+extern "C"
+void governor_domain_subscribe(struct gov_domain* domain, size_t threadId)
+{
+    ToGovernor(domain)->Subscribe(threadId);
+}
+
+extern "C"
+int governor_domain_reset(struct gov_domain* domain)
+{
+    return ToGovernor(domain)->Reset();
+}
+
+extern "C"
+void governor_domain_register_strategy(struct gov_domain* domain,
+    const char* name, const struct gov_strategy* strategy)
+{
+    ToGovernor(domain)->RegisterStrategy(name, new CStrategy(*strategy));
+}
@@ -23,38 +23,126 @@
 #define GOVERNOR 0
 #endif // GOVERNOR
 
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+// info given to a scheduling strategy at each scheduling point
+struct gov_step
+{
+    size_t step; // index of scheduling point in the current sequence
+    size_t num_threads; // number of threads that can be run
+    const size_t* thread_ids; // threadIds that can be run, in increasing order
+    const size_t* sites; // id of control point site each thread is at
+};
+
+// user-provided scheduling strategy
+// `data` is passed to every callback
+struct gov_strategy
+{
+    void* data;
+    // if non-zero, `last` is read from file instead of being the last
+    //  sequence run in this process
+    int reads_schedule;
+    // prepare next schedule sequence, `last` holds the threadIds chosen in
+    //  the last sequence, and `done` is non-zero if it reached the end
+    // returns zero if there are no more sequences to run
+    // may be NULL
+    int (*reset)(void* data, const size_t* last, size_t last_len, int done);
+    // return threadId to run, must be one of step->thread_ids
+    size_t (*choose)(void* data, const struct gov_step* step);
+};
+
+// independent scheduling domain, see GOV_DOMAIN_CREATE()
+struct gov_domain;
+
 #if GOVERNOR == 0
 
 // macro user API
 #define GOV_PREPARE(numThreads)
 #define GOV_SUBSCRIBE(threadId)
+#define GOV_SUBSCRIBE_SYMMETRIC(threadId, symClass)
 #define GOV_UNSUBSCRIBE()
 #define GOV_CONTROL()
+#define GOV_CONTROL_READ(addr)
+#define GOV_CONTROL_WRITE(addr)
 #define GOV_RESET() (1)
+#define GOV_REGISTER_STRATEGY(name, strategy)
+#define GOV_DOMAIN_CREATE(name) ((struct gov_domain*)0)
+#define GOV_DOMAIN_DESTROY(domain)
+#define GOV_DOMAIN_PREPARE(domain, numThreads)
+#define GOV_DOMAIN_SUBSCRIBE(domain, threadId)
+#define GOV_DOMAIN_RESET(domain) (1)
+#define GOV_DOMAIN_REGISTER_STRATEGY(domain, name, strategy)
 
 #else // if GOVERNOR
 
 #define GOV_PREPARE(numThreads) governor_prepare(numThreads)
 #define GOV_SUBSCRIBE(threadId) governor_subscribe(threadId)
+#define GOV_SUBSCRIBE_SYMMETRIC(threadId, symClass) \
+    governor_subscribe_symmetric(threadId, symClass)
 #define GOV_UNSUBSCRIBE() governor_unsubscribe()
-#define GOV_CONTROL() governor_control()
+#define GOV_CONTROL() governor_control_site(__FILE__, __LINE__, __func__)
+#define GOV_CONTROL_READ(addr) \
+    governor_control_access(__FILE__, __LINE__, __func__, addr, 0)
+#define GOV_CONTROL_WRITE(addr) \
+    governor_control_access(__FILE__, __LINE__, __func__, addr, 1)
 #define GOV_RESET() governor_reset()
-
-#ifdef __cplusplus
-#include <cstddef>
-#else
-#include <stddef.h>
-#endif
+#define GOV_REGISTER_STRATEGY(name, strategy) \
+    governor_register_strategy(name, strategy)
+#define GOV_DOMAIN_CREATE(name) governor_domain_create(name)
+#define GOV_DOMAIN_DESTROY(domain) governor_domain_destroy(domain)
+#define GOV_DOMAIN_PREPARE(domain, numThreads) \
+    governor_domain_prepare(domain, numThreads)
+#define GOV_DOMAIN_SUBSCRIBE(domain, threadId) \
+    governor_domain_subscribe(domain, threadId)
+#define GOV_DOMAIN_RESET(domain) governor_domain_reset(domain)
+#define GOV_DOMAIN_REGISTER_STRATEGY(domain, name, strategy) \
+    governor_domain_register_strategy(domain, name, strategy)
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void governor_prepare(size_t numThreads);
+// same as governor_prepare(), for threads launched one at a time, used by
+//  gov::thread
+// each call expects one more thread and returns its threadId, in launch
+//  order, and scheduling waits until governor_launched() is called
+size_t governor_launch();
+void governor_launched();
 void governor_subscribe(size_t threadId);
+// threads subscribed with the same symClass must run the same code on the
+//  same inputs, only one permutation of them is scheduled
+void governor_subscribe_symmetric(size_t threadId, size_t symClass);
 void governor_unsubscribe();
 void governor_control();
+// same as governor_control(), but identifies the control point site
+void governor_control_site(const char* file, int line, const char* func);
+// same as governor_control_site(), but also tells that the calling thread
+//  reads (or writes, if isWrite is non-zero) addr after the control point
+void governor_control_access(const char* file, int line, const char* func,
+    const void* addr, int isWrite);
 int governor_reset();
+// register a scheduling strategy, which is used if GOV_MODE is `name`
+// strategy is copied, but `data` must outlive the governor
+void governor_register_strategy(const char* name,
+    const struct gov_strategy* strategy);
+
+// scheduling domains, each with its own threads, strategy and schedule file,
+//  which can run at the same time in one process
+// threads subscribed to a domain call governor_control*() and
+//  governor_unsubscribe() as usual
+struct gov_domain* governor_domain_create(const char* name);
+// all threads must have unsubscribed from the domain
+void governor_domain_destroy(struct gov_domain* domain);
+void governor_domain_prepare(struct gov_domain* domain, size_t numThreads);
+void governor_domain_subscribe(struct gov_domain* domain, size_t threadId);
+int governor_domain_reset(struct gov_domain* domain);
+void governor_domain_register_strategy(struct gov_domain* domain,
+    const char* name, const struct gov_strategy* strategy);
 
 #ifdef __cplusplus
 }
@@ -62,5 +150,78 @@ int governor_reset();
 
 #endif // GOVERNOR
 
+#ifdef __cplusplus
+#include <thread>
+#include <utility>
+#include <type_traits>
+
+namespace gov
+{
+
+// std::thread whose function runs subscribed to the governor
+// there's no need to call GOV_PREPARE() or GOV_SUBSCRIBE(): threads get
+//  threadIds in the order they are launched, starting from 0 for each
+//  group of threads, and scheduling starts once the launching thread joins
+//  (or detaches) one of them, which ends the group
+class thread
+{
+public:
+    thread() noexcept = default;
+
+    template <typename F, typename... Args>
+    explicit thread(F&& f, Args&&... args)
+    {
+#if GOVERNOR
+        size_t threadId = governor_launch();
+#else
+        size_t threadId = 0;
+#endif
+        _thread = std::thread(&thread::Run<typename std::decay<F>::type,
+            typename std::decay<Args>::type...>, threadId,
+            std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    thread(thread&&) noexcept = default;
+    thread& operator=(thread&&) noexcept = default;
+
+    bool joinable() const noexcept { return _thread.joinable(); }
+    std::thread::id get_id() const noexcept { return _thread.get_id(); }
+
+    void join()
+    {
+        EndLaunch();
+        _thread.join();
+    }
+
+    void detach()
+    {
+        EndLaunch();
+        _thread.detach();
+    }
+
+private:
+    template <typename F, typename... Args>
+    static void Run(size_t threadId, F f, Args... args)
+    {
+        (void)threadId;
+        GOV_SUBSCRIBE(threadId);
+        f(std::move(args)...);
+        GOV_UNSUBSCRIBE();
+    }
+
+    static void EndLaunch()
+    {
+#if GOVERNOR
+        governor_launched();
+#endif
+    }
+
+private:
+    std::thread _thread;
+};
+
+} // namespace gov
+#endif // __cplusplus
+
 #endif // __GOVERNOR_H__
 
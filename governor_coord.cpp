@@ -0,0 +1,436 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+#include <atomic>
+#include <random>
+#include <algorithm>
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "governor_coord.h"
+#include "governor_impl.h"
+
+// set once the segment is initialized
+constexpr uint64_t COORD_MAGIC = 0x474f56434f4f5244ul;
+
+enum SlotState
+{
+    SLOT_FREE       = 0, // no work, and not waiting for any
+    SLOT_WAITING    = 1,
+    SLOT_ACTIVE     = 2,
+};
+
+struct CoordItem
+{
+    size_t floor;
+    uint32_t done;
+    uint32_t len;
+    SchedPoint points[COORD_MAX_POINTS];
+};
+
+struct CoordSlot
+{
+    uint32_t state;
+    uint32_t fixed; // slot was given by GOV_WORKER, keep it across processes
+    uint32_t finished; // its worker saw that no work is left
+    pid_t pid; // process using the slot
+    CoordItem item;
+};
+
+// shared memory is zeroed on creation, which is a valid initial state
+//  for everything but the mutex and the queue
+struct CoordSegment
+{
+    std::atomic<uint64_t> ready;
+    pthread_mutex_t mutex;
+    std::atomic<uint64_t> nextSeed;
+    std::atomic<uint64_t> numRuns;
+    std::atomic<uint64_t> numFailures;
+    std::atomic<uint32_t> reported;
+    size_t queueHead;
+    size_t queueLen;
+    CoordSlot slots[COORD_MAX_WORKERS];
+    CoordItem queue[COORD_MAX_ITEMS];
+};
+
+static void CopyItem(CoordItem& dst, WorkItem const& src)
+{
+    if (src.prefix.size() > COORD_MAX_POINTS)
+    {
+        GOV_ERR("sequence of %lu steps is too long to share, at most %lu",
+            src.prefix.size(), COORD_MAX_POINTS);
+        error_abort();
+    }
+
+    dst.floor = src.floor;
+    dst.done = src.done;
+    dst.len = src.prefix.size();
+    std::copy(src.prefix.begin(), src.prefix.end(), dst.points);
+}
+
+static void CopyItem(WorkItem& dst, CoordItem const& src)
+{
+    dst.floor = src.floor;
+    dst.done = src.done;
+    dst.prefix.assign(src.points, src.points + src.len);
+}
+
+Coordinator::Coordinator(std::string const& name, size_t worker) :
+    _name((name[0] == '/') ? name : "/" + name)
+{
+    std::string const& shmName = _name;
+
+    // first process creates the segment, others wait until it's ready
+    int fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR,
+        S_IRUSR | S_IWUSR);
+    bool creator = (fd != -1);
+    if (!creator && errno == EEXIST)
+        fd = shm_open(shmName.c_str(), O_RDWR, S_IRUSR | S_IWUSR);
+
+    if (fd == -1)
+    {
+        GOV_ERR("failed to open shared memory %s", shmName.c_str());
+        error_abort();
+    }
+
+    if (creator)
+    {
+        if (ftruncate(fd, sizeof(CoordSegment)) == -1)
+        {
+            GOV_ERR("failed to size shared memory %s", shmName.c_str());
+            error_abort();
+        }
+    }
+    else
+    {
+        struct stat st;
+        while (fstat(fd, &st) == 0 && (size_t)st.st_size < sizeof(CoordSegment))
+            usleep(1000);
+    }
+
+    void* ptr = mmap(nullptr, sizeof(CoordSegment), PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+    {
+        GOV_ERR("failed to map shared memory %s", shmName.c_str());
+        error_abort();
+    }
+
+    _seg = (CoordSegment*)ptr;
+
+    if (creator)
+    {
+        // robust, so that a worker dying while holding it doesn't
+        //  block the others
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&_seg->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+
+        std::random_device r;
+        _seg->nextSeed = r();
+
+        // the whole schedule tree
+        _seg->queue[0].floor = 0;
+        _seg->queue[0].done = false;
+        _seg->queue[0].len = 0;
+        _seg->queueHead = 0;
+        _seg->queueLen = 1;
+
+        _seg->ready = COORD_MAGIC;
+    }
+    else
+    {
+        while (_seg->ready.load() != COORD_MAGIC)
+            usleep(1000);
+    }
+
+    Lock();
+
+    if (worker == SIZE_MAX)
+    {
+        // take a free slot, possibly from a worker that died
+        ReclaimDead();
+        for (worker = 0; worker < COORD_MAX_WORKERS; ++worker)
+        {
+            CoordSlot& slot = _seg->slots[worker];
+            if (!slot.fixed && slot.pid == 0 && slot.state == SLOT_FREE)
+                break;
+        }
+
+        if (worker == COORD_MAX_WORKERS)
+        {
+            GOV_ERR("no free worker slot in %s, at most %lu workers",
+                shmName.c_str(), COORD_MAX_WORKERS);
+            error_abort();
+        }
+    }
+    else if (worker >= COORD_MAX_WORKERS)
+    {
+        GOV_ERR("invalid GOV_WORKER variable %lu, at most %lu workers",
+            worker, COORD_MAX_WORKERS);
+        error_abort();
+    }
+    else
+    {
+        CoordSlot& slot = _seg->slots[worker];
+        if (slot.pid && slot.pid != getpid() && kill(slot.pid, 0) == 0)
+        {
+            GOV_ERR("worker %lu is already run by process %d",
+                worker, slot.pid);
+            error_abort();
+        }
+
+        slot.fixed = true;
+        // previous process may have died while waiting
+        if (slot.state == SLOT_WAITING)
+            slot.state = SLOT_FREE;
+    }
+
+    _worker = worker;
+    _seg->slots[_worker].pid = getpid();
+
+    Unlock();
+}
+
+Coordinator::~Coordinator()
+{
+    Lock();
+
+    CoordSlot& slot = _seg->slots[_worker];
+    // a process with a fixed slot is followed by another one that resumes
+    //  its work, else the work goes back to the queue
+    if (!slot.fixed && slot.state == SLOT_ACTIVE)
+    {
+        if (_seg->queueLen < COORD_MAX_ITEMS)
+        {
+            size_t idx = (_seg->queueHead + _seg->queueLen) % COORD_MAX_ITEMS;
+            _seg->queue[idx] = slot.item;
+            _seg->queueLen++;
+        }
+        else
+            GOV_ERR("work queue is full, worker %lu work is lost", _worker);
+
+        slot.state = SLOT_FREE;
+    }
+
+    if (slot.state == SLOT_WAITING)
+        slot.state = SLOT_FREE;
+
+    slot.pid = 0;
+
+    Unlock();
+
+    munmap(_seg, sizeof(CoordSegment));
+}
+
+uint32_t Coordinator::NextSeed()
+{
+    // spread consecutive seeds
+    uint64_t n = _seg->nextSeed.fetch_add(1);
+    return (uint32_t)((n * 0x9E3779B97F4A7C15ul) >> 32);
+}
+
+bool Coordinator::Load(WorkItem& item)
+{
+    Lock();
+
+    CoordSlot& slot = _seg->slots[_worker];
+    bool active = (slot.state == SLOT_ACTIVE);
+    if (active)
+        CopyItem(item, slot.item);
+
+    Unlock();
+    return active;
+}
+
+void Coordinator::Save(WorkItem const& item)
+{
+    Lock();
+
+    CoordSlot& slot = _seg->slots[_worker];
+    CopyItem(slot.item, item);
+    slot.state = SLOT_ACTIVE;
+
+    Unlock();
+}
+
+void Coordinator::Record(size_t step, SchedPoint const& sp)
+{
+    if (step >= COORD_MAX_POINTS)
+    {
+        GOV_ERR("sequence of %lu steps is too long to share, at most %lu",
+            step + 1, COORD_MAX_POINTS);
+        error_abort();
+    }
+
+    CoordItem& item = _seg->slots[_worker].item;
+    item.points[step] = sp;
+    item.len = step + 1;
+}
+
+bool Coordinator::WantsWork()
+{
+    Lock();
+
+    size_t waiting = 0;
+    for (CoordSlot& slot : _seg->slots)
+        waiting += (slot.state == SLOT_WAITING);
+
+    bool ret = (waiting > _seg->queueLen);
+
+    Unlock();
+    return ret;
+}
+
+bool Coordinator::Give(WorkItem const& item)
+{
+    Lock();
+
+    bool ret = (_seg->queueLen < COORD_MAX_ITEMS);
+    if (ret)
+    {
+        size_t idx = (_seg->queueHead + _seg->queueLen) % COORD_MAX_ITEMS;
+        CopyItem(_seg->queue[idx], item);
+        _seg->queueLen++;
+    }
+
+    Unlock();
+    return ret;
+}
+
+bool Coordinator::Take(WorkItem& item)
+{
+    CoordSlot& slot = _seg->slots[_worker];
+    while (true)
+    {
+        Lock();
+
+        slot.state = SLOT_WAITING;
+        ReclaimDead();
+
+        if (_seg->queueLen)
+        {
+            CoordItem& front = _seg->queue[_seg->queueHead];
+            CopyItem(item, front);
+            slot.item = front;
+            slot.state = SLOT_ACTIVE;
+            _seg->queueHead = (_seg->queueHead + 1) % COORD_MAX_ITEMS;
+            _seg->queueLen--;
+
+            Unlock();
+            return true;
+        }
+
+        // done once nobody has work that could be shared
+        bool active = false;
+        for (CoordSlot& s : _seg->slots)
+            active = active || (s.state == SLOT_ACTIVE);
+
+        if (!active)
+        {
+            slot.state = SLOT_FREE;
+            slot.finished = true;
+            if (_seg->reported.exchange(1) == 0)
+                fprintf(stderr, "RUN_EXPLORE - all work done, %lu schedules "
+                    "run, %lu failed\n", _seg->numRuns.load(),
+                    _seg->numFailures.load());
+
+            // the segment is removed once no process needs it, so that the
+            //  name can be used for a new campaign
+            // processes of a fixed slot are started until one sees that the
+            //  campaign is over, and would start a new one if it were gone
+            bool needed = false;
+            for (CoordSlot& s : _seg->slots)
+                needed = needed || (s.fixed && !s.finished);
+
+            if (!needed)
+                shm_unlink(_name.c_str());
+
+            Unlock();
+            return false;
+        }
+
+        Unlock();
+        usleep(1000);
+    }
+}
+
+void Coordinator::AddRun()
+{
+    _seg->numRuns.fetch_add(1);
+}
+
+void Coordinator::AddFailure()
+{
+    _seg->numFailures.fetch_add(1);
+}
+
+void Coordinator::Lock()
+{
+    // previous owner died, state it protects is still consistent as it is
+    //  only modified by plain stores
+    if (pthread_mutex_lock(&_seg->mutex) == EOWNERDEAD)
+        pthread_mutex_consistent(&_seg->mutex);
+}
+
+void Coordinator::Unlock()
+{
+    pthread_mutex_unlock(&_seg->mutex);
+}
+
+void Coordinator::ReclaimDead()
+{
+    for (size_t i = 0; i < COORD_MAX_WORKERS; ++i)
+    {
+        CoordSlot& slot = _seg->slots[i];
+        if (slot.fixed || slot.pid == 0 ||
+            kill(slot.pid, 0) == 0 || errno != ESRCH)
+            continue;
+
+        // the sequence it was running likely crashed, so skip it
+        // if the queue is full, try again later
+        if (slot.state == SLOT_ACTIVE)
+        {
+            if (_seg->queueLen == COORD_MAX_ITEMS)
+                continue;
+
+            GOV_ERR("worker %lu (process %d) died, requeuing its work",
+                i, slot.pid);
+            size_t idx = (_seg->queueHead + _seg->queueLen) % COORD_MAX_ITEMS;
+            _seg->queue[idx] = slot.item;
+            _seg->queue[idx].done = true;
+            _seg->queueLen++;
+        }
+
+        slot.state = SLOT_FREE;
+        slot.pid = 0;
+    }
+}
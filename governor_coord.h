@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GOVERNOR_COORD_H__
+#define __GOVERNOR_COORD_H__
+
+#include <cstdint>
+#include <cstdio>
+
+#include <vector>
+#include <string>
+
+#include "governor_strategy.h"
+
+// max worker processes, queued work items, and steps in a shared sequence
+constexpr size_t COORD_MAX_WORKERS = 64;
+constexpr size_t COORD_MAX_ITEMS = 64;
+constexpr size_t COORD_MAX_POINTS = 4096;
+
+// a subtree of the schedule tree, for RUN_EXPLORE
+// all sequences that start with prefix[0, floor), and whose choice at
+//  `floor` comes after prefix[floor] (or is it, if !done)
+struct WorkItem
+{
+    size_t floor = 0;
+    bool done = false; // whether the sequence in prefix was already run
+    std::vector<SchedPoint> prefix;
+};
+
+struct CoordSegment;
+
+// coordinates governed processes that run one campaign in parallel
+// processes share a named POSIX shared memory segment, holding a queue of
+//  work items, each worker's current item, seed and result counters
+// workers that run out of work wait for others to share theirs, and the
+//  campaign is over once no worker has work left
+class Coordinator
+{
+public:
+    // attach to segment `name`, creating it if needed
+    // `worker` is the slot used by this process, or SIZE_MAX to take any
+    //  free slot, which is released when the process exits
+    Coordinator(std::string const& name, size_t worker);
+    ~Coordinator();
+
+    size_t Worker() const { return _worker; }
+    // get a seed that no other worker gets
+    uint32_t NextSeed();
+
+    // get item this worker is working on, returns false if it has none
+    bool Load(WorkItem& item);
+    // save item this worker is working on
+    void Save(WorkItem const& item);
+    // record step of the sequence this worker is running
+    // does not lock, the slot is only read by others once the worker dies
+    void Record(size_t step, SchedPoint const& sp);
+    // whether there are waiting workers that no queued item is left for
+    bool WantsWork();
+    // queue item for other workers, returns false if the queue is full
+    bool Give(WorkItem const& item);
+    // take a queued item, waiting until one is available
+    // returns false once no worker has any work left, and removes the
+    //  segment once every worker of a fixed slot saw it
+    bool Take(WorkItem& item);
+
+    // count a sequence run, or failed
+    // AddFailure() is async-signal-safe
+    void AddRun();
+    void AddFailure();
+
+private:
+    void Lock();
+    void Unlock();
+    // queue item of a worker process that died, must hold lock
+    void ReclaimDead();
+
+private:
+    std::string _name; // of the segment
+    CoordSegment* _seg = nullptr;
+    size_t _worker = 0;
+};
+
+#endif // __GOVERNOR_COORD_H__
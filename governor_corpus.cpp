@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <dirent.h>
+
+#include "governor_corpus.h"
+#include "governor_impl.h"
+
+CorpusStrategy::CorpusStrategy(const char* dir, size_t jobs, bool strict) :
+    _dir(dir), _jobs(std::max<size_t>(jobs, 1)), _strict(strict)
+{
+    DIR* d = opendir(dir);
+    if (d == nullptr)
+    {
+        GOV_ERR("failed to open corpus dir %s", dir);
+        error_abort();
+    }
+
+    // every file but hidden ones, such as fuzzing coverage
+    while (struct dirent* ent = readdir(d))
+    {
+        if (ent->d_name[0] == '.' || ent->d_type == DT_DIR)
+            continue;
+
+        _files.push_back(_dir + "/" + ent->d_name);
+    }
+
+    closedir(d);
+    std::sort(_files.begin(), _files.end());
+
+    // workers share which files were taken and their results
+    _sharedSize = _jobs * sizeof(size_t) + _files.size() * sizeof(FileResult);
+    void* ptr = mmap(nullptr, _sharedSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        GOV_ERR("failed to map shared memory");
+        error_abort();
+    }
+
+    // mapping is zeroed, so all files are pending
+    _shared = ptr;
+    _workerFiles = (size_t*)ptr;
+    _results = (FileResult*)(_workerFiles + _jobs);
+    for (size_t i = 0; i < _jobs; ++i)
+        _workerFiles[i] = SIZE_MAX;
+}
+
+CorpusStrategy::~CorpusStrategy()
+{
+    // worker exited normally, so the file it ran passed
+    if (_worker != SIZE_MAX)
+        EndFile();
+
+    munmap(_shared, _sharedSize);
+}
+
+bool CorpusStrategy::Reset(std::vector<SchedPoint>& /*last*/,
+    bool /*done*/)
+{
+    // only workers run files
+    if (_worker == SIZE_MAX)
+        return true;
+
+    EndFile();
+    return NextFile();
+}
+
+size_t CorpusStrategy::Choose(StepContext const& ctx)
+{
+    _started = true;
+    _steps = std::max(_steps, ctx.step + 1);
+
+    // once the program stops following the file, run the lowest threadId
+    //  until the end
+    size_t idx = ctx.step;
+    if (!_diverged && idx < _sched.size())
+    {
+        SchedPoint const& sp = _sched[idx];
+        auto itr = std::lower_bound(ctx.threadIds.begin(),
+            ctx.threadIds.end(), sp.threadId);
+        if (itr != ctx.threadIds.end() && *itr == sp.threadId &&
+            sp.available == ctx.threadIds.size())
+            return sp.threadId;
+    }
+
+    if (!_diverged)
+    {
+        GOV_ERR("RUN_CORPUS - %s diverged at step %lu",
+            _files[_file].c_str(), idx);
+        _diverged = true;
+    }
+
+    return ctx.threadIds.front();
+}
+
+bool CorpusStrategy::HasWork() const
+{
+    for (size_t i = 0; i < _files.size(); ++i)
+    {
+        if (_results[i].status.load() == FILE_PENDING)
+            return true;
+    }
+
+    return false;
+}
+
+void CorpusStrategy::StartWorker(size_t worker)
+{
+    _worker = worker;
+
+    // other workers may have taken the last files
+    if (!NextFile())
+        std::_Exit(EXIT_SUCCESS);
+}
+
+void CorpusStrategy::WorkerExited(size_t worker, pid_t /*pid*/, int status)
+{
+    // file the worker was running failed, unless it exited normally
+    size_t file = _workerFiles[worker];
+    _workerFiles[worker] = SIZE_MAX;
+    if (file == SIZE_MAX)
+        return;
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    {
+        uint32_t running = FILE_RUNNING;
+        _results[file].status.compare_exchange_strong(running, FILE_PASSED);
+        return;
+    }
+
+    _results[file].status = FILE_FAILED;
+    _results[file].detail = WIFSIGNALED(status) ?
+        -WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+int CorpusStrategy::Finish(FILE* out)
+{
+    size_t counts[FILE_UNREADABLE + 1] = { };
+    for (size_t i = 0; i < _files.size(); ++i)
+    {
+        uint32_t status = _results[i].status.load();
+        int detail = _results[i].detail;
+        counts[status]++;
+
+        if (status == FILE_FAILED && detail < 0)
+            fprintf(out, "RUN_CORPUS - FAIL %s (signal %d)\n",
+                _files[i].c_str(), -detail);
+        else if (status == FILE_FAILED)
+            fprintf(out, "RUN_CORPUS - FAIL %s (exit status %d)\n",
+                _files[i].c_str(), detail);
+        else if (status == FILE_DIVERGED)
+            fprintf(out, "RUN_CORPUS - DIVERGED %s\n", _files[i].c_str());
+        else if (status == FILE_UNREADABLE)
+            fprintf(out, "RUN_CORPUS - UNREADABLE %s\n", _files[i].c_str());
+        else if (status != FILE_PASSED)
+            fprintf(out, "RUN_CORPUS - NOT RUN %s\n", _files[i].c_str());
+    }
+
+    fprintf(out, "RUN_CORPUS - %lu files, %lu passed, %lu diverged, "
+        "%lu failed, %lu unreadable\n", _files.size(), counts[FILE_PASSED],
+        counts[FILE_DIVERGED], counts[FILE_FAILED], counts[FILE_UNREADABLE]);
+
+    // diverged files only fail the run if strict, as the program may have
+    //  changed on purpose
+    size_t passed = counts[FILE_PASSED] + (_strict ? 0 : counts[FILE_DIVERGED]);
+    return (passed == _files.size()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void CorpusStrategy::EndFile()
+{
+    if (_file == SIZE_MAX)
+        return;
+
+    // a file that wasn't run is left for another worker
+    // one that the program ended before is diverged
+    if (!_started)
+        _results[_file].status = FILE_PENDING;
+    else if (_diverged || _steps < _sched.size())
+        _results[_file].status = FILE_DIVERGED;
+    else
+        _results[_file].status = FILE_PASSED;
+
+    _workerFiles[_worker] = SIZE_MAX;
+    _file = SIZE_MAX;
+}
+
+bool CorpusStrategy::NextFile()
+{
+    _sched.clear();
+    _started = false;
+    _steps = 0;
+    _diverged = false;
+
+    // a file that can't be read is skipped, and fails the run
+    for (size_t file = 0; file < _files.size(); ++file)
+    {
+        uint32_t pending = FILE_PENDING;
+        if (!_results[file].status.compare_exchange_strong(pending,
+            FILE_RUNNING))
+            continue;
+
+        _file = file;
+        _workerFiles[_worker] = file;
+
+        FILE* f = std::fopen(_files[file].c_str(), "r");
+        if (f == nullptr)
+        {
+            GOV_ERR("RUN_CORPUS - failed to open %s", _files[file].c_str());
+            _results[file].status = FILE_UNREADABLE;
+            // so that neither EndFile() nor WorkerExited() overwrite it
+            _file = _workerFiles[_worker] = SIZE_MAX;
+            continue;
+        }
+
+        SchedPoint sp;
+        char line[128];
+        while (std::fgets(line, sizeof(line), f) && sp.read(line))
+            _sched.push_back(sp);
+
+        std::fclose(f);
+        return true;
+    }
+
+    return false;
+}
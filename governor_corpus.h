@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GOVERNOR_CORPUS_H__
+#define __GOVERNOR_CORPUS_H__
+
+#include <cstdint>
+#include <cstdio>
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+#include "governor_strategy.h"
+
+// replays every schedule file in a directory, used in RUN_CORPUS
+// files are run by worker processes, so that a failing one doesn't stop
+//  the others, and each file is reported as passed, diverged (the program
+//  no longer follows it), failed or unreadable
+class CorpusStrategy : public Strategy
+{
+public:
+    // runs files in `dir` with `jobs` workers
+    // if `strict`, diverged files fail the run too
+    CorpusStrategy(const char* dir, size_t jobs, bool strict);
+    ~CorpusStrategy();
+
+    bool WritesSchedule() const override { return false; }
+
+    bool Reset(std::vector<SchedPoint>& last, bool done) override;
+    size_t Choose(StepContext const& ctx) override;
+
+    size_t NumWorkers() const override { return _jobs; }
+    bool HasWork() const override;
+    void StartWorker(size_t worker) override;
+    void WorkerExited(size_t worker, pid_t pid, int status) override;
+    int Finish(FILE* out) override;
+
+private:
+    enum FileStatus
+    {
+        FILE_PENDING    = 0,
+        FILE_RUNNING    = 1,
+        FILE_PASSED     = 2,
+        FILE_DIVERGED   = 3,
+        FILE_FAILED     = 4,
+        FILE_UNREADABLE = 5,
+    };
+
+    // files are taken by workers by setting their status to FILE_RUNNING
+    struct FileResult
+    {
+        std::atomic<uint32_t> status;
+        int detail; // signal or exit status, if failed
+    };
+
+    // finish file being run, if any
+    void EndFile();
+    // take the next file to run, returns false if there's none
+    bool NextFile();
+
+private:
+    std::string _dir;
+    size_t _jobs;
+    bool _strict;
+    std::vector<std::string> _files;
+
+    // shared with the workers, mapped before forking
+    // file run by each worker, and result of each file
+    void* _shared = nullptr;
+    size_t _sharedSize = 0;
+    size_t* _workerFiles = nullptr;
+    FileResult* _results = nullptr;
+
+    // worker state
+    size_t _worker = SIZE_MAX;
+    size_t _file = SIZE_MAX; // file being run
+    std::vector<SchedPoint> _sched;
+    bool _started = false; // file started running
+    size_t _steps = 0; // steps of the file run so far
+    bool _diverged = false;
+};
+
+#endif // __GOVERNOR_CORPUS_H__
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "governor_farm.h"
+#include "governor_impl.h"
+
+FarmStrategy::FarmStrategy(uint32_t seed, size_t jobs,
+    std::string const& file, std::string const& dir) :
+    RandomStrategy(seed), _seed(seed), _jobs(jobs), _file(file), _dir(dir)
+{
+    mkdir(_dir.c_str(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+
+    // failures are saved as site-<site>-seed-<seed>
+    if (DIR* d = opendir(_dir.c_str()))
+    {
+        while (struct dirent* ent = readdir(d))
+        {
+            size_t site;
+            if (std::sscanf(ent->d_name, "site-%lu-", &site) == 1)
+                _sites.insert(site);
+        }
+
+        closedir(d);
+    }
+
+    _sharedSize = sizeof(std::atomic<uint32_t>) + _jobs * sizeof(uint32_t);
+    void* ptr = mmap(nullptr, _sharedSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        GOV_ERR("failed to map shared memory");
+        error_abort();
+    }
+
+    _shared = ptr;
+    _numStarted = new (ptr) std::atomic<uint32_t>(0);
+    _seeds = (uint32_t*)(_numStarted + 1);
+}
+
+FarmStrategy::~FarmStrategy()
+{
+    munmap(_shared, _sharedSize);
+}
+
+void FarmStrategy::StartWorker(size_t worker)
+{
+    // n-th worker started uses the n-th seed after the campaign's
+    uint32_t seed = _seed + _numStarted->fetch_add(1) + 1;
+    _seeds[worker] = seed;
+    Seed(seed);
+}
+
+void FarmStrategy::WorkerExited(size_t worker, pid_t pid, int status)
+{
+    // a worker that exits with an error (e.g. failed a check) has no FAIL
+    //  marker, nor a site, so the last sequence it ran is kept as is
+    if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+    {
+        _numFailures++;
+
+        std::string path = _file + "." + std::to_string(worker);
+        std::string dst = _dir + "/exit-" +
+            std::to_string(WEXITSTATUS(status)) + "-seed-" +
+            std::to_string(_seeds[worker]);
+        if (std::rename(path.c_str(), dst.c_str()) != 0)
+        {
+            GOV_ERR("RUN_RANDOM - worker %lu exited with status %d, failed "
+                "to move %s to %s", worker, WEXITSTATUS(status), path.c_str(),
+                dst.c_str());
+            return;
+        }
+
+        fprintf(stderr, "RUN_RANDOM - worker %lu exited with status %d, "
+            "saved to %s\n", worker, WEXITSTATUS(status), dst.c_str());
+        return;
+    }
+
+    if (!WIFSIGNALED(status))
+        return;
+
+    _numFailures++;
+
+    // failing sequence was copied to <file>.<worker>.fail.<pid>
+    std::string path = _file + "." + std::to_string(worker) + ".fail." +
+        std::to_string(pid);
+    FILE* f = std::fopen(path.c_str(), "r");
+    if (f == nullptr)
+    {
+        GOV_ERR("RUN_RANDOM - worker %lu died with signal %d, without saving "
+            "its sequence", worker, WTERMSIG(status));
+        return;
+    }
+
+    std::string contents;
+    char buffer[4096];
+    size_t len;
+    while ((len = std::fread(buffer, 1, sizeof(buffer), f)) > 0)
+        contents.append(buffer, len);
+    std::fclose(f);
+
+    // FAIL <sig> <site> ends the sequence
+    int sig = 0;
+    size_t site = 0;
+    size_t pos = contents.rfind("FAIL ");
+    if (pos == std::string::npos ||
+        std::sscanf(contents.c_str() + pos, "FAIL %d %lu", &sig, &site) != 2)
+    {
+        GOV_ERR("RUN_RANDOM - invalid failing sequence in %s", path.c_str());
+        return;
+    }
+
+    // only the first failure at each site is kept
+    if (_sites.insert(site).second)
+    {
+        _numNew++;
+
+        std::string dst = _dir + "/site-" + std::to_string(site) + "-seed-" +
+            std::to_string(_seeds[worker]);
+        if (std::rename(path.c_str(), dst.c_str()) != 0)
+        {
+            GOV_ERR("RUN_RANDOM - failed to move %s to %s", path.c_str(),
+                dst.c_str());
+            return;
+        }
+
+        fprintf(stderr, "RUN_RANDOM - new failure (signal %d) at site %lu, "
+            "saved to %s\n", sig, site, dst.c_str());
+        return;
+    }
+
+    std::remove(path.c_str());
+}
+
+int FarmStrategy::Finish(FILE* out)
+{
+    fprintf(out, "RUN_RANDOM - %u workers started, %lu failed, %lu at new "
+        "sites, %lu sites in %s\n", _numStarted->load(), _numFailures,
+        _numNew, _sites.size(), _dir.c_str());
+
+    return _numFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GOVERNOR_FARM_H__
+#define __GOVERNOR_FARM_H__
+
+#include <cstdint>
+#include <cstdio>
+
+#include <vector>
+#include <string>
+#include <set>
+#include <atomic>
+
+#include "governor_strategy.h"
+
+// runs RUN_RANDOM in several worker processes, each with its own seed
+// failing sequences are collected in a directory, one per control point
+//  site the failing thread was at, so repeated failures are discarded
+class FarmStrategy : public RandomStrategy
+{
+public:
+    // `file` is the schedule file, workers write `file`.<worker>
+    FarmStrategy(uint32_t seed, size_t jobs, std::string const& file,
+        std::string const& dir);
+    ~FarmStrategy();
+
+    size_t NumWorkers() const override { return _jobs; }
+    bool HasWork() const override { return true; }
+    void StartWorker(size_t worker) override;
+    void WorkerExited(size_t worker, pid_t pid, int status) override;
+    int Finish(FILE* out) override;
+
+private:
+    uint32_t _seed;
+    size_t _jobs;
+    std::string _file;
+    std::string _dir;
+    // sites of failures collected, in this or previous campaigns
+    std::set<size_t> _sites;
+
+    // shared with the workers, mapped before forking
+    // number of workers started, and seed of each running one
+    void* _shared = nullptr;
+    size_t _sharedSize = 0;
+    std::atomic<uint32_t>* _numStarted = nullptr;
+    uint32_t* _seeds = nullptr;
+
+    size_t _numFailures = 0;
+    size_t _numNew = 0; // failures at new sites
+};
+
+#endif // __GOVERNOR_FARM_H__
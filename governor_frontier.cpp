@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+#include <algorithm>
+
+#include "governor_frontier.h"
+#include "governor_impl.h"
+
+FrontierStrategy::FrontierStrategy(SearchOrder order, std::string const& path,
+    size_t bound) :
+    _order(order),
+    _path(path),
+    _bound(bound),
+    _frontier(NodeLess{order})
+{
+    Load();
+}
+
+FrontierStrategy::~FrontierStrategy()
+{
+    if (_journal)
+        std::fclose(_journal);
+
+    for (Node* node : _frontier)
+        delete node;
+    delete _node;
+}
+
+bool FrontierStrategy::Reset(std::vector<SchedPoint>& /*last*/,
+    bool /*done*/)
+{
+    const char* name = (_order == ORDER_PREEMPTIONS) ? "RUN_BFS" : "RUN_BEST";
+
+    // node that was run is now fully expanded, its children were added
+    //  to the frontier as they were found
+    if (_node)
+    {
+        delete _node;
+        _node = nullptr;
+        _numRuns++;
+    }
+
+    // start from the root if there's nothing to resume
+    if (_numRuns == 0 && _frontier.empty() && _nextId == 0)
+        Push(new Node{0, 0, 0, {}});
+
+    // rewrite journal once it's mostly made of removed entries
+    if (_journalLines > 2 * _frontier.size() + 1024)
+        Compact();
+    std::fflush(_journal);
+
+    if (_frontier.empty())
+    {
+        GOV_ERR("%s - reached last state", name);
+        return false;
+    }
+
+    // prepare state for the next sequence
+    _forcedIdx = 0;
+    _lastThreadId = SIZE_MAX;
+    _lastSite = 0;
+    _preemptions = 0;
+    _sitePairs.clear();
+
+    return true;
+}
+
+size_t FrontierStrategy::Choose(StepContext const& ctx)
+{
+    // next node is only taken once a sequence starts, so that none is
+    //  lost if the campaign stops
+    if (_node == nullptr)
+    {
+        _node = Pop();
+        std::fflush(_journal);
+    }
+
+    // the frontier is only empty once Reset() returned false, so the
+    //  program runs on after GOV_RESET() returned 0
+    if (_node == nullptr)
+    {
+        const char* name = (_order == ORDER_PREEMPTIONS) ? "RUN_BFS" :
+            "RUN_BEST";
+        GOV_ERR("%s - no schedule left to run, at step %lu", name, ctx.step);
+        error_abort();
+    }
+
+    std::vector<size_t> const& threadIds = ctx.threadIds;
+    auto lastItr = std::lower_bound(threadIds.begin(), threadIds.end(),
+        _lastThreadId);
+    bool lastRunnable = (lastItr != threadIds.end() && *lastItr == _lastThreadId);
+
+    // default continuation keeps running the last thread, if possible
+    size_t threadId = lastRunnable ? _lastThreadId : threadIds.front();
+    if (_forcedIdx < _node->forced.size() &&
+        _node->forced[_forcedIdx].first == ctx.step)
+        threadId = _node->forced[_forcedIdx++].second;
+
+    auto itr = std::lower_bound(threadIds.begin(), threadIds.end(), threadId);
+    assert(itr != threadIds.end() && *itr == threadId);
+    size_t idx = itr - threadIds.begin();
+
+    // choosing any other thread from here on is an unexplored subtree
+    // subtrees are journaled as they're found, so that none is lost if the
+    //  sequence crashes
+    size_t prefixEnd = _node->forced.empty() ? 0 :
+        _node->forced.back().first + 1;
+    for (size_t i = 0; ctx.step >= prefixEnd && i < threadIds.size(); ++i)
+    {
+        size_t alt = threadIds[i];
+        if (i == idx)
+            continue;
+
+        size_t preemptions = _preemptions +
+            (lastRunnable && alt != _lastThreadId);
+        if (_bound && preemptions > _bound)
+            continue;
+
+        bool switched = (_lastThreadId != SIZE_MAX && alt != _lastThreadId);
+        size_t score = _sitePairs.size() + (switched &&
+            !_sitePairs.count(std::make_pair(_lastSite, ctx.sites[i])));
+
+        Node* child = new Node{0, preemptions, score, _node->forced};
+        child->forced.emplace_back(ctx.step, alt);
+        Push(child);
+    }
+    if (ctx.step >= prefixEnd && threadIds.size() > 1)
+        std::fflush(_journal);
+
+    // update state with the choice made
+    if (lastRunnable && threadId != _lastThreadId)
+        _preemptions++;
+    if (_lastThreadId != SIZE_MAX && threadId != _lastThreadId)
+        _sitePairs.emplace(_lastSite, ctx.sites[idx]);
+
+    _lastThreadId = threadId;
+    _lastSite = ctx.sites[idx];
+
+    return threadId;
+}
+
+void FrontierStrategy::Report(FILE* out) const
+{
+    const char* name = (_order == ORDER_PREEMPTIONS) ? "RUN_BFS" : "RUN_BEST";
+    fprintf(out, "%s - %lu schedules run, %lu in frontier",
+        name, _numRuns, _frontier.size());
+    if (_node)
+        fprintf(out, ", current has %lu preemptions and score %lu",
+            _node->preemptions, _node->score);
+    fprintf(out, "\n");
+}
+
+bool FrontierStrategy::NodeLess::operator()(Node const* a, Node const* b) const
+{
+    if (order == ORDER_SCORE && a->score != b->score)
+        return a->score > b->score;
+    if (a->preemptions != b->preemptions)
+        return a->preemptions < b->preemptions;
+
+    return a->id < b->id;
+}
+
+void FrontierStrategy::Push(Node* node)
+{
+    node->id = _nextId++;
+    _frontier.insert(node);
+    Log("+", node);
+}
+
+FrontierStrategy::Node* FrontierStrategy::Pop()
+{
+    if (_frontier.empty())
+        return nullptr;
+
+    Node* node = *_frontier.begin();
+    _frontier.erase(_frontier.begin());
+    // a node is logged as removed before it runs, so a crash while running
+    //  it doesn't make the next campaign run it again
+    Log("-", node);
+    return node;
+}
+
+void FrontierStrategy::Load()
+{
+    // journal lines are "+ id preemptions score n step threadId ..." when
+    //  a node is added, and "- id" when it is removed
+    std::map<size_t, Node*> nodes;
+    if (FILE* f = std::fopen(_path.c_str(), "r"))
+    {
+        char op;
+        size_t id;
+        while (std::fscanf(f, " %c %lu", &op, &id) == 2)
+        {
+            _nextId = std::max(_nextId, id + 1);
+            if (op == '-')
+            {
+                auto itr = nodes.find(id);
+                if (itr != nodes.end())
+                {
+                    delete itr->second;
+                    nodes.erase(itr);
+                }
+
+                continue;
+            }
+
+            Node* node = new Node{id, 0, 0, {}};
+            size_t n = 0;
+            bool ok = (std::fscanf(f, "%lu %lu %lu", &node->preemptions,
+                &node->score, &n) == 3);
+            for (size_t i = 0; ok && i < n; ++i)
+            {
+                size_t step, threadId;
+                ok = (std::fscanf(f, "%lu %lu", &step, &threadId) == 2);
+                node->forced.emplace_back(step, threadId);
+            }
+
+            // ignore truncated entries, from a crash while logging
+            if (!ok)
+            {
+                delete node;
+                break;
+            }
+
+            delete nodes[id];
+            nodes[id] = node;
+        }
+
+        std::fclose(f);
+    }
+
+    for (auto p : nodes)
+        _frontier.insert(p.second);
+
+    Compact();
+}
+
+void FrontierStrategy::Compact()
+{
+    if (_journal)
+        std::fclose(_journal);
+
+    _journalLines = 0;
+
+    // write current frontier to a new journal, then append to it
+    bool ok = WriteFileAtomic(_path, [this](FILE* f) {
+        _journal = f;
+        for (Node* node : _frontier)
+            Log("+", node);
+    });
+
+    _journal = ok ? std::fopen(_path.c_str(), "a") : nullptr;
+    if (_journal == nullptr)
+    {
+        GOV_ERR("failed to write %s", _path.c_str());
+        error_abort();
+    }
+}
+
+void FrontierStrategy::Log(const char* op, Node const* node)
+{
+    _journalLines++;
+    if (op[0] == '-')
+    {
+        fprintf(_journal, "- %lu\n", node->id);
+        return;
+    }
+
+    fprintf(_journal, "+ %lu %lu %lu %lu", node->id, node->preemptions,
+        node->score, node->forced.size());
+    for (auto p : node->forced)
+        fprintf(_journal, " %lu %lu", p.first, p.second);
+    fprintf(_journal, "\n");
+}
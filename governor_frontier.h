@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GOVERNOR_FRONTIER_H__
+#define __GOVERNOR_FRONTIER_H__
+
+#include <cstdio>
+
+#include <vector>
+#include <set>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "governor_strategy.h"
+
+// order in which the frontier of the schedule tree is explored
+enum SearchOrder
+{
+    // fewest preemptions first, i.e. iterative context bounding
+    ORDER_PREEMPTIONS   = 0,
+    // highest score first, score is the number of distinct pairs of sites
+    //  between which a context switch happened
+    ORDER_SCORE         = 1,
+};
+
+// explores the schedule tree in a given order, keeping a frontier of
+//  unexplored subtrees
+// a subtree is identified by the choices that deviate from the default
+//  continuation (keep running the last thread if possible, otherwise
+//  the lowest threadId), so frontier entries stay small
+// the frontier is journaled to a file, so campaigns can resume
+class FrontierStrategy : public Strategy
+{
+public:
+    // `path` is the frontier journal, `bound` the max number of
+    //  preemptions in a sequence (0 for unbounded)
+    FrontierStrategy(SearchOrder order, std::string const& path,
+        size_t bound);
+    ~FrontierStrategy();
+
+    bool Reset(std::vector<SchedPoint>& last, bool done) override;
+    size_t Choose(StepContext const& ctx) override;
+    void Report(FILE* out) const override;
+
+private:
+    struct Node
+    {
+        size_t id; // insertion order, breaks ties
+        size_t preemptions;
+        size_t score;
+        // (step, threadId) pairs that deviate from the default continuation
+        std::vector<std::pair<size_t, size_t>> forced;
+    };
+
+    // orders nodes, first one is the next to explore
+    struct NodeLess
+    {
+        SearchOrder order;
+        bool operator()(Node const* a, Node const* b) const;
+    };
+
+    void Push(Node* node);
+    Node* Pop();
+
+    // journal helpers
+    void Load();
+    void Compact();
+    void Log(const char* op, Node const* node);
+
+private:
+    SearchOrder _order;
+    std::string _path;
+    size_t _bound;
+    FILE* _journal = nullptr;
+    size_t _journalLines = 0;
+
+    std::set<Node*, NodeLess> _frontier;
+    size_t _nextId = 0;
+    size_t _numRuns = 0;
+
+    // node being run
+    Node* _node = nullptr;
+    // state of the sequence being run
+    size_t _forcedIdx = 0;
+    size_t _lastThreadId = SIZE_MAX;
+    size_t _lastSite = 0;
+    size_t _preemptions = 0;
+    std::set<std::pair<size_t, size_t>> _sitePairs;
+};
+
+#endif // __GOVERNOR_FRONTIER_H__
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <functional>
+
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include "governor_fuzz.h"
+#include "governor_impl.h"
+
+// coverage map filled by -fsanitize-coverage=trace-pc-guard callbacks
+// updates are racy, which is fine, we only need approximate hit counts
+static uint8_t sPcMap[FUZZ_MAP_SIZE];
+
+// callbacks are weak, so that a sanitizer/fuzzer runtime can override them
+extern "C" __attribute__((weak))
+void __sanitizer_cov_trace_pc_guard_init(uint32_t* start, uint32_t* stop)
+{
+    static uint32_t numGuards = 0;
+    if (start == stop || *start)
+        return; // already initialized
+
+    for (uint32_t* guard = start; guard < stop; ++guard)
+        *guard = ++numGuards;
+}
+
+extern "C" __attribute__((weak))
+void __sanitizer_cov_trace_pc_guard(uint32_t* guard)
+{
+    uint8_t& hits = sPcMap[*guard & (FUZZ_MAP_SIZE - 1)];
+    if (hits < 0xFF)
+        hits++;
+}
+
+// classify hit counts into buckets, as done by AFL
+// a run is interesting if it hits a new (edge, bucket) pair
+static uint8_t Bucket(uint8_t hits)
+{
+    if (hits <= 2)
+        return hits;
+    if (hits == 3)
+        return 4;
+    if (hits < 8)
+        return 8;
+    if (hits < 16)
+        return 16;
+    if (hits < 32)
+        return 32;
+    if (hits < 128)
+        return 64;
+    return 128;
+}
+
+// merge bucketed hits into seen map, clearing hits
+// returns true if there's new coverage
+static bool MergeMap(uint8_t* hits, uint8_t* seen)
+{
+    bool novel = false;
+    for (size_t i = 0; i < FUZZ_MAP_SIZE; ++i)
+    {
+        if (hits[i] == 0)
+            continue;
+
+        uint8_t b = Bucket(hits[i]);
+        if (b & ~seen[i])
+        {
+            seen[i] |= b;
+            novel = true;
+        }
+
+        hits[i] = 0;
+    }
+
+    return novel;
+}
+
+FuzzStrategy::FuzzStrategy(const char* dir, uint32_t seed) :
+    _dir(dir),
+    _runMap(FUZZ_MAP_SIZE, 0),
+    _seenMap(FUZZ_MAP_SIZE, 0),
+    _seenPcMap(FUZZ_MAP_SIZE, 0),
+    _rng(seed)
+{
+    mkdir(dir, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+
+    DIR* d = opendir(dir);
+    if (d == nullptr)
+    {
+        GOV_ERR("failed to open corpus dir %s", dir);
+        error_abort();
+    }
+
+    while (struct dirent* ent = readdir(d))
+    {
+        if (std::strncmp(ent->d_name, "sched-", 6) != 0)
+            continue;
+
+        std::string path = _dir + "/" + ent->d_name;
+        FILE* f = std::fopen(path.c_str(), "r");
+        if (f == nullptr)
+            continue;
+
+        std::vector<size_t> input;
+        SchedPoint sp;
+        char line[128];
+        while (std::fgets(line, sizeof(line), f) && sp.read(line))
+            input.push_back(sp.threadId);
+
+        std::fclose(f);
+        if (!input.empty())
+            _corpus.push_back(input);
+    }
+
+    closedir(d);
+
+    // coverage seen by previous runs
+    std::string path = _dir + "/.coverage";
+    if (FILE* f = std::fopen(path.c_str(), "r"))
+    {
+        if (std::fread(_seenMap.data(), 1, FUZZ_MAP_SIZE, f) != FUZZ_MAP_SIZE ||
+            std::fread(_seenPcMap.data(), 1, FUZZ_MAP_SIZE, f) != FUZZ_MAP_SIZE)
+        {
+            std::fill(_seenMap.begin(), _seenMap.end(), 0);
+            std::fill(_seenPcMap.begin(), _seenPcMap.end(), 0);
+        }
+
+        std::fclose(f);
+    }
+}
+
+bool FuzzStrategy::Reset(std::vector<SchedPoint>& /*last*/,
+    bool /*done*/)
+{
+    _input.clear();
+    _step = 0;
+    _prevSite = 0;
+    // drop coverage from code run in between schedules
+    std::fill(std::begin(sPcMap), std::end(sPcMap), 0);
+
+    // with an empty corpus, the run is fully random
+    if (_corpus.empty())
+        return true;
+
+    std::uniform_int_distribution<size_t> dist(0, _corpus.size() - 1);
+    _input = _corpus[dist(_rng)];
+    Mutate(_input);
+    return true;
+}
+
+size_t FuzzStrategy::Choose(StepContext const& ctx)
+{
+    std::vector<size_t> const& threadIds = ctx.threadIds;
+    size_t idx = 0;
+    if (_step < _input.size())
+    {
+        // use first threadId that is >= the one in the input
+        // (mutations can produce threadIds that are not available)
+        auto itr = std::lower_bound(threadIds.begin(), threadIds.end(),
+            _input[_step]);
+        idx = (itr == threadIds.end()) ? 0 : (itr - threadIds.begin());
+    }
+    else
+    {
+        // past the input, choose randomly
+        std::uniform_int_distribution<size_t> dist(0, threadIds.size() - 1);
+        idx = dist(_rng);
+    }
+
+    _step++;
+
+    // record transition between the previously run site and this one
+    size_t cur = std::hash<size_t>()(ctx.sites[idx]) & (FUZZ_MAP_SIZE - 1);
+    uint8_t& hits = _runMap[cur ^ _prevSite];
+    if (hits < 0xFF)
+        hits++;
+    _prevSite = cur >> 1;
+
+    return threadIds[idx];
+}
+
+void FuzzStrategy::Report(FILE* out) const
+{
+    size_t edges = std::count_if(_seenMap.begin(), _seenMap.end(),
+        [](uint8_t b) { return b != 0; });
+    size_t pcEdges = std::count_if(_seenPcMap.begin(), _seenPcMap.end(),
+        [](uint8_t b) { return b != 0; });
+
+    fprintf(out, "RUN_FUZZ - %lu corpus entries, %lu site transitions, "
+        "%lu pc edges covered\n", _corpus.size(), edges, pcEdges);
+}
+
+void FuzzStrategy::End(std::vector<SchedPoint> const& sched)
+{
+    bool novel = MergeMap(_runMap.data(), _seenMap.data());
+    novel |= MergeMap(sPcMap, _seenPcMap.data());
+
+    if (!novel || sched.empty())
+        return;
+
+    std::vector<size_t> input;
+    for (SchedPoint const& sp : sched)
+        input.push_back(sp.threadId);
+
+    _corpus.push_back(input);
+
+    // name corpus entries after their content, so duplicates collapse
+    size_t hash = 0;
+    for (size_t threadId : input)
+        hash = hash * 31 + threadId + 1;
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "/sched-%016lx", hash);
+    WriteSchedule(_dir + name, sched);
+
+    SaveCoverage();
+}
+
+void FuzzStrategy::Mutate(std::vector<size_t>& input)
+{
+    std::uniform_int_distribution<size_t> numDist(1, 4);
+    size_t numMutations = numDist(_rng);
+    for (size_t m = 0; m < numMutations && !input.empty(); ++m)
+    {
+        std::uniform_int_distribution<size_t> posDist(0, input.size() - 1);
+        size_t pos = posDist(_rng);
+
+        switch (_rng() % 5)
+        {
+            case 0: // truncate, rest of the schedule is random
+                input.resize(pos);
+                break;
+            case 1: // replace with a threadId used elsewhere in the input
+                input[pos] = input[posDist(_rng)];
+                break;
+            case 2: // swap adjacent steps
+                if (pos + 1 < input.size())
+                    std::swap(input[pos], input[pos + 1]);
+                break;
+            case 3: // delete step
+                input.erase(input.begin() + pos);
+                break;
+            case 4: // splice with another corpus entry
+            {
+                std::uniform_int_distribution<size_t> dist(0, _corpus.size() - 1);
+                std::vector<size_t> const& other = _corpus[dist(_rng)];
+                if (pos < other.size())
+                {
+                    input.resize(pos);
+                    input.insert(input.end(), other.begin() + pos, other.end());
+                }
+                break;
+            }
+        }
+    }
+}
+
+void FuzzStrategy::SaveCoverage()
+{
+    std::string path = _dir + "/.coverage";
+    bool ok = WriteFileAtomic(path, [this](FILE* f) {
+        std::fwrite(_seenMap.data(), 1, FUZZ_MAP_SIZE, f);
+        std::fwrite(_seenPcMap.data(), 1, FUZZ_MAP_SIZE, f);
+    });
+
+    if (!ok)
+        GOV_ERR("failed to write %s", path.c_str());
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GOVERNOR_FUZZ_H__
+#define __GOVERNOR_FUZZ_H__
+
+#include <cstdint>
+
+#include <vector>
+#include <string>
+#include <random>
+
+#include "governor_strategy.h"
+
+// size of coverage maps, must be a power of 2
+constexpr size_t FUZZ_MAP_SIZE = 1 << 16;
+
+// coverage-guided schedule fuzzer, used in RUN_FUZZ
+// inputs are sequences of threadIds to schedule, and novelty is measured
+//  by transitions between control point sites and, if the program is
+//  compiled with -fsanitize-coverage=trace-pc-guard, by compiler coverage
+// interesting schedules are kept in a corpus directory, in the same format
+//  as the schedule file, so they can be replayed with RUN_PRESET
+class FuzzStrategy : public Strategy
+{
+public:
+    // loads corpus (and coverage seen so far) from directory
+    // directory is created if it does not exist
+    FuzzStrategy(const char* dir, uint32_t seed);
+
+    // prepares the input for the next sequence by mutating a corpus entry
+    bool Reset(std::vector<SchedPoint>& last, bool done) override;
+    size_t Choose(StepContext const& ctx) override;
+    // if the sequence run covered something new, it's added to the corpus
+    void End(std::vector<SchedPoint> const& sched) override;
+    void Report(FILE* out) const override;
+
+    size_t CorpusSize() const { return _corpus.size(); }
+
+private:
+    void Mutate(std::vector<size_t>& input);
+    // save coverage seen so far to the corpus directory
+    void SaveCoverage();
+
+private:
+    std::string _dir;
+    std::vector<std::vector<size_t>> _corpus;
+    // input used in the current run, and position in it
+    std::vector<size_t> _input;
+    size_t _step = 0;
+    // previous site, used to compute site transitions
+    size_t _prevSite = 0;
+    // hit counts of current run, and (bucketed) coverage seen so far
+    std::vector<uint8_t> _runMap;
+    std::vector<uint8_t> _seenMap;
+    std::vector<uint8_t> _seenPcMap;
+
+    std::minstd_rand _rng;
+};
+
+#endif // __GOVERNOR_FUZZ_H__
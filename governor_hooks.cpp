@@ -16,6 +16,10 @@
  */
 
 #include <pthread.h>
+#include <signal.h>
+
+#include <cstdlib>
+#include <atomic>
 
 #include "governor_hooks.h"
 #include "governor_impl.h"
@@ -24,6 +28,11 @@
 // global variables
 static pthread_key_t dummyKey; // used for thread exit hook
 static bool isInit = false;
+// signals caught by crash_hook(), and the actions they had before
+static const int crashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+static struct sigaction oldActions[NSIG];
+// set by error_abort(), so that the abort isn't taken for a crash
+static std::atomic<bool> isErrorAbort(false);
 
 // call initializer() at process startup
 __attribute__((constructor))
@@ -34,6 +43,10 @@ void initializer()
 
     isInit = true;
     pthread_key_create(&dummyKey, unsub_hook);
+
+    // publish the default governor before any thread uses it
+    // this only reads options, files are set up once it is first used
+    Governor::CreateDefault();
 }
 
 // call finalizer() at process finish
@@ -53,5 +66,44 @@ void sub_hook()
 
 void unsub_hook(void* /*argptr*/)
 {
-    sGovernor->Unsubscribe();
+    if (Governor* governor = Governor::Current(false))
+        governor->Unsubscribe();
+}
+
+void crash_hooks()
+{
+    // each governor calls this once set up, but the handlers the program
+    //  had are only those found the first time
+    static std::atomic<bool> installed(false);
+    if (installed.exchange(true))
+        return;
+
+    struct sigaction sa;
+    sa.sa_handler = crash_hook;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+
+    for (int sig : crashSignals)
+        sigaction(sig, &sa, &oldActions[sig]);
+}
+
+void crash_hook(int sig)
+{
+    // the governor of the crashing thread's domain saves its sequence
+    if (!isErrorAbort.load())
+    {
+        if (Governor* governor = Governor::Current(false))
+            governor->HandleCrash(sig);
+    }
+
+    // then the program's own handler, or the default action, takes the
+    //  signal, re-raised with the action it had before
+    sigaction(sig, &oldActions[sig], nullptr);
+    raise(sig);
+}
+
+void error_abort()
+{
+    isErrorAbort = true;
+    std::abort();
 }
@@ -26,5 +26,13 @@ void finalizer();
 //  be called when that thread exits
 void sub_hook();
 void unsub_hook(void* argptr);
+// fatal signal hooks, so the governor can save failing sequences
+// crash_hooks() installs them once, keeping the program's own handlers,
+//  which crash_hook() passes the signal on to
+void crash_hooks();
+void crash_hook(int sig);
+// aborts on a governor error (e.g. an invalid option), which crash_hook()
+//  doesn't take for a failure of the program
+[[noreturn]] void error_abort();
 
 #endif // __GOVERNOR_HOOKS_H_
\ No newline at end of file
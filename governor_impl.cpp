@@ -18,7 +18,10 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cassert>
+#include <cinttypes>
 #include <cstring>
+#include <cctype>
+#include <cerrno>
 
 #include <vector>
 #include <algorithm>
@@ -26,80 +29,61 @@
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <fcntl.h>
 #include <unistd.h>
 
 #include "governor.h"
 #include "governor_hooks.h"
 #include "governor_impl.h"
+#include "governor_fuzz.h"
+#include "governor_frontier.h"
+#include "governor_corpus.h"
+#include "governor_farm.h"
+#include "governor_uniform.h"
 
 #define PAGE (1 << 12)
 
-#define GOV_ERR(str, ...) \
-    fprintf(stderr, "%s:%d %s " str "\n", __FILE__, \
-            __LINE__, __func__, ##__VA_ARGS__);
-
-// file where scheduling data is kept
+// default file where scheduling data is kept
 constexpr const char* GOV_FILE = "gov.data";
 
-size_t SchedPoint::read(char* buffer)
-{
-    int nchars = 0; // number of chars read
-    int ret = std::sscanf(buffer, "%lu %lu %lu\n%n",
-        &threadId, &available, &higher, &nchars);
-
-    if (ret <= 0 || nchars <= 0)
-        return 0u;
+__thread Governor* Governor::_current = nullptr;
+__thread size_t Governor::_threadSite = 0;
+std::atomic<Governor*> Governor::_default(nullptr);
 
-    return nchars;
-}
-
-size_t SchedPoint::write(char* buffer, size_t size)
+// read a numeric environment variable, returns `def` if it isn't set
+static size_t GetEnvSize(const char* name, size_t def)
 {
-    int ret = std::snprintf(buffer, size, "%lu %lu %lu\n",
-        threadId, available, higher);
-
-    if (ret <= 0)
-        return 0u;
-
-    return ret;
-}
-
-Governor::Governor()
-{
-    std::unique_lock<std::mutex> lock(_mutex);
-
-    // open schedule file
-    _fileDesc = open(GOV_FILE, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    char* env = getenv(name);
+    if (env == nullptr || *env == '\0')
+        return def;
 
-    if (_fileDesc == -1)
+    char* end = nullptr;
+    unsigned long long val = std::strtoull(env, &end, 10);
+    if (*end != '\0')
     {
-        GOV_ERR("failed to open or create %s", GOV_FILE);
-        std::abort();
+        GOV_ERR("invalid %s variable %s", name, env);
+        error_abort();
     }
 
-    // get size of file, in multiples of page
-    if (_fileDesc != -1)
-    {
-        struct stat st;
-        fstat(_fileDesc, &st);
-        _fileSize = (st.st_size / PAGE) * PAGE + ((st.st_size % PAGE) ? PAGE : 0);
-        // init file with at least 1 page of storage
-        if (_fileSize == 0)
-            _fileSize = PAGE;
+    return val;
+}
 
-        // map file into memory
-        MapFileToMem(_fileSize);
-    }
+Governor::Governor(const char* domain /*= nullptr*/) :
+    _domain(domain ? domain : "")
+{
+    // only options are read here, files and strategies are set up once the
+    //  governor is first used, see Init()
+    if (_domain.empty())
+        _default = this;
 
     // initialize running thread
     // constructor "constructs an id that does not represent a thread"
     _activeThreadId = std::thread::id();
-    // init rng
-    std::random_device r;
-    _rng = std::minstd_rand(r());
 
     // prepare run mode
+    // names other than the built-in modes refer to user strategies
+    _modeName = "RUN_PRESET";
     if (char* env = getenv("GOV_MODE"))
     {
         std::string s(env);
@@ -111,29 +95,241 @@ Governor::Governor()
         };
 
         if (s == "RUN_RANDOM" || starts_with("RAND"))
-            _runMode = RUN_RANDOM;
+            _modeName = "RUN_RANDOM";
         else if (s == "RUN_EXPLORE" || starts_with("EXP"))
-            _runMode = RUN_EXPLORE;
+            _modeName = "RUN_EXPLORE";
         else if (s == "RUN_PRESET" || starts_with("PRE"))
-            _runMode = RUN_PRESET;
+            _modeName = "RUN_PRESET";
+        else if (s == "RUN_PCT" || starts_with("PCT"))
+            _modeName = "RUN_PCT";
+        else if (s == "RUN_FUZZ" || starts_with("FUZZ"))
+            _modeName = "RUN_FUZZ";
+        else if (s == "RUN_BFS" || starts_with("BFS"))
+            _modeName = "RUN_BFS";
+        else if (s == "RUN_BEST" || starts_with("BEST"))
+            _modeName = "RUN_BEST";
+        else if (s == "RUN_DELAY" || starts_with("DEL"))
+            _modeName = "RUN_DELAY";
+        else if (s == "RUN_CORPUS" || starts_with("CORP"))
+            _modeName = "RUN_CORPUS";
+        else if (s == "RUN_UNIFORM" || starts_with("UNI"))
+            _modeName = "RUN_UNIFORM";
+        else if (s == "RUN_LOCAL" || starts_with("LOC"))
+            _modeName = "RUN_LOCAL";
         else
+            _modeName = s;
+    }
+
+    // campaign budgets, 0 means unlimited
+    _budgetRuns = GetEnvSize("GOV_BUDGET_RUNS", 0);
+    _budgetSecs = GetEnvSize("GOV_BUDGET_SECS", 0);
+
+    // save failing sequences on fatal signals, unless GOV_CATCH_SIGNALS=0
+    // with GOV_STOP_ON_FAIL=1, a run following a failed one stops instead
+    //  of moving on to the next sequence
+    _stopOnFail = GetEnvSize("GOV_STOP_ON_FAIL", 0);
+    _catchSignals = GetEnvSize("GOV_CATCH_SIGNALS", 1);
+
+    // max times a thread can run at the same site while no other thread
+    //  runs, 0 for unlimited
+    _spinLimit = GetEnvSize("GOV_SPIN_LIMIT", 0);
+
+    // site filters, comma separated lists of files, functions, file:line
+    //  or site ids
+    // control points not included, or excluded, are ignored
+    auto splitList = [](const char* env) -> std::vector<std::string> {
+        std::vector<std::string> list;
+        std::string s(env ? env : "");
+        size_t start = 0;
+        while (start < s.size())
         {
-            GOV_ERR("invalid GOV_MODE variable %s", s.c_str());
-            std::abort();
+            size_t end = s.find(',', start);
+            if (end == std::string::npos)
+                end = s.size();
+            if (end > start)
+                list.push_back(s.substr(start, end - start));
+            start = end + 1;
         }
+
+        return list;
+    };
+    _sitesInclude = splitList(getenv("GOV_SITES_INCLUDE"));
+    _sitesExclude = splitList(getenv("GOV_SITES_EXCLUDE"));
+
+    // with GOV_REPORT, statistics are written to that file in JSON at exit
+    //  and, with GOV_REPORT_EVERY=N, every N sequences
+    if (char* path = getenv("GOV_REPORT"))
+        _reportPath = DomainPath(path);
+    _reportEvery = GetEnvSize("GOV_REPORT_EVERY", 0);
+}
+
+void Governor::Init()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _initialized = true;
+
+    // processes running a campaign together share work through the
+    //  GOV_COORD shared memory segment
+    // GOV_WORKER fixes the worker slot used, so that workers can be run
+    //  as one process per schedule
+    if (char* coord = getenv("GOV_COORD"))
+    {
+        _coord.reset(new Coordinator(DomainPath(coord),
+            GetEnvSize("GOV_WORKER", SIZE_MAX)));
+    }
+
+    // schedule file is GOV_FILE, and each worker has its own, along with
+    //  the files named after it
+    char* fileEnv = getenv("GOV_FILE");
+    _fileName = DomainPath((fileEnv && *fileEnv) ? fileEnv : GOV_FILE);
+    if (_coord)
+        _fileName += "." + std::to_string(_coord->Worker());
+
+    OpenFile();
+
+    // init rng
+    // workers get distinct seeds from the coordinator
+    std::random_device r;
+    _rng = std::minstd_rand(_coord ? _coord->NextSeed() : r());
+
+    // create built-in strategy, if that's the mode used
+    Strategy* strategy = nullptr;
+    if (_modeName == "RUN_RANDOM")
+    {
+        // with GOV_JOBS, run by that many worker processes, and keep
+        //  failures in GOV_FAILURES dir
+        size_t jobs = GetEnvSize("GOV_JOBS", 0);
+        char* dir = getenv("GOV_FAILURES");
+        if (jobs)
+            strategy = new FarmStrategy(_rng(), jobs, _fileName,
+                dir ? dir : "gov.failures");
+        else
+            strategy = new RandomStrategy(_rng());
+    }
+    else if (_modeName == "RUN_UNIFORM")
+        strategy = new UniformStrategy(_rng());
+    else if (_modeName == "RUN_EXPLORE")
+        strategy = new ExploreStrategy(GetEnvSize("GOV_PROGRESS", 0),
+            _coord.get());
+    else if (_modeName == "RUN_PRESET")
+        strategy = new PresetStrategy();
+    else if (_modeName == "RUN_LOCAL")
+    {
+        // GOV_LOCAL_PREFIX steps of the schedule are kept, and the next
+        //  GOV_LOCAL_WINDOW steps (0 for all) vary
+        strategy = new LocalStrategy(_fileName + ".local",
+            GetEnvSize("GOV_LOCAL_PREFIX", 0),
+            GetEnvSize("GOV_LOCAL_WINDOW", 0));
+    }
+    else if (_modeName == "RUN_PCT")
+    {
+        // GOV_PCT_DEPTH is the bug depth d, GOV_PCT_STEPS an initial
+        //  estimate of the schedule length k
+        size_t depth = std::max<size_t>(GetEnvSize("GOV_PCT_DEPTH", 3), 1);
+        size_t steps = GetEnvSize("GOV_PCT_STEPS", 0);
+        strategy = new PctStrategy(_rng(), depth, steps);
+    }
+    else if (_modeName == "RUN_FUZZ")
+    {
+        // fuzzing corpus is kept in GOV_CORPUS dir
+        char* dir = getenv("GOV_CORPUS");
+        strategy = new FuzzStrategy(
+            DomainPath(dir ? dir : "gov.corpus").c_str(), _rng());
+    }
+    else if (_modeName == "RUN_BFS" || _modeName == "RUN_BEST")
+    {
+        // frontier is journaled next to the schedule file
+        // GOV_PREEMPTION_BOUND limits preemptions per sequence
+        SearchOrder order = (_modeName == "RUN_BFS") ?
+            ORDER_PREEMPTIONS : ORDER_SCORE;
+        strategy = new FrontierStrategy(order,
+            _fileName + ".frontier",
+            GetEnvSize("GOV_PREEMPTION_BOUND", 0));
+    }
+
+    else if (_modeName == "RUN_DELAY")
+    {
+        // GOV_DELAY_BOUND limits delays per sequence
+        // planned delays are kept next to the schedule file
+        strategy = new DelayStrategy(_fileName + ".delays",
+            GetEnvSize("GOV_DELAY_BOUND", 2));
+    }
+
+    else if (_modeName == "RUN_CORPUS")
+    {
+        // schedules in GOV_CORPUS dir are run by GOV_JOBS workers
+        // GOV_CORPUS_STRICT=1 fails the run on diverged files too
+        char* dir = getenv("GOV_CORPUS");
+        strategy = new CorpusStrategy(dir ? dir : "gov.corpus",
+            GetEnvSize("GOV_JOBS", 1), GetEnvSize("GOV_CORPUS_STRICT", 0));
+    }
+
+    if (strategy)
+    {
+        _strategies[_modeName].reset(strategy);
+        _strategy = strategy;
+    }
+
+    // budgets count from the first use
+    _startTime = std::chrono::steady_clock::now();
+
+    // with GOV_TRACES=1, count sequences that yield distinct traces
+    // with GOV_ARCHIVE, sequences of new traces are saved to that dir
+    if (char* dir = getenv("GOV_ARCHIVE"))
+    {
+        _archiveDir = dir;
+        mkdir(dir, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+    }
+    // with GOV_CHECKPOINT_SECS=N, RUN_EXPLORE saves its position every N
+    //  seconds, to resume from if the schedule file is lost or cut short
+    // coordinated workers keep their position in the coordinator instead
+    if (_modeName == "RUN_EXPLORE" && !_coord)
+        _checkpointSecs = GetEnvSize("GOV_CHECKPOINT_SECS", 0);
+    _lastCheckpoint = _startTime;
+
+    if (GetEnvSize("GOV_TRACES", 0) || !_archiveDir.empty())
+    {
+        _traces.reset(new TraceSet(_fileName + ".traces"));
+        _traces->Begin();
     }
 
     lock.unlock();
     // read/open seq file
-    Reset(true);
+    // with a user strategy, this is done once it is registered
+    if (_strategy)
+        Reset(true);
+
+    // only once set up, so that setup errors aren't taken for failures
+    if (_catchSignals)
+        crash_hooks();
 }
 
 Governor::~Governor()
 {
     std::lock_guard<std::mutex> lock(_mutex);
 
-    // close seq file
-    HandleOutFile(true);
+    if (_default == this)
+        _default = nullptr;
+
+    // nothing to close if the governor was never used
+    if (!_initialized)
+        return;
+
+    // close seq file, if a sequence was scheduled since the last Reset()
+    if (_strategy && !_sched.empty())
+    {
+        EndSequence();
+        if (_checkpointSecs)
+            WriteCheckpoint();
+    }
+
+    if (_traces)
+        fprintf(stderr, "%s - %lu unique traces, %lu new in %lu schedules\n",
+            _modeName.c_str(), _traces->NumUnique(), _traces->NumNew(),
+            _traces->NumTraces());
+
+    if (!_reportPath.empty())
+        WriteReport();
 
     munmap(_filePtr, _fileSize);
     _filePtr = nullptr;
@@ -147,116 +343,447 @@ Governor::~Governor()
     CPU_FREE(_cpuSet);
 }
 
+void Governor::CreateDefault()
+{
+    // the constructor publishes it, and it's destroyed at exit after
+    //  everything constructed later, as a function-local static would be
+    new Governor();
+    std::atexit([] { delete _default.load(); });
+}
+
+Governor* Governor::CreateDomain(const char* name)
+{
+    if (name == nullptr || *name == '\0')
+    {
+        GOV_ERR("domain name can't be empty");
+        error_abort();
+    }
+
+    return new Governor(name);
+}
+
+void Governor::DestroyDomain(Governor* domain)
+{
+    // subscribed threads, and those yet to subscribe, would be left
+    //  pointing at a deleted governor
+    {
+        std::lock_guard<std::mutex> lock(domain->_mutex);
+        if (!domain->_threads.empty() || domain->_threadsToSub ||
+            domain->_launching)
+        {
+            GOV_ERR("domain %s destroyed with %lu threads subscribed and "
+                "%lu to subscribe", domain->_domain.c_str(),
+                domain->_threads.size(), domain->_threadsToSub);
+            error_abort();
+        }
+    }
+
+    if (_current == domain)
+        _current = nullptr;
+
+    delete domain;
+}
+
+std::string Governor::DomainPath(std::string const& path) const
+{
+    return _domain.empty() ? path : path + "." + _domain;
+}
+
 bool Governor::Reset(bool force /*= false*/)
 {
     std::lock_guard<std::mutex> lock(_mutex);
+    _current = this;
+
+    // once a budget is exhausted, there's nothing more to run
+    if (_stopped)
+        return false;
 
     // if no scheduling has been done, ignore call
     // this is needed in case the user calls Reset() several times
-    if (!force && _schedIdx == 0)
+    if (!force && _sched.empty())
         return true;
 
-    if (_schedIdx > 0)
+    Strategy* strategy = GetStrategy();
+    _inReset = true;
+
+    // last sequence is done, unless it's read from file and found
+    //  to be incomplete
+    _schedDone = !_sched.empty();
+    if (!_sched.empty())
     {
         // close seq file
-        HandleOutFile(true);
+        EndSequence();
+        if (_reportEvery && _numRuns % _reportEvery == 0)
+            WriteReport();
+
+        // stop if budget is exhausted
+        // the file is left with the last sequence, so that the next
+        //  process resumes from it
+        if (BudgetExhausted())
+        {
+            if (_checkpointSecs)
+                WriteCheckpoint();
+            // strategy still accounts for the last sequence
+            strategy->Reset(_sched, true);
+            strategy->Report(stderr);
+            _sched.clear();
+            _stopped = true;
+            _inReset = false;
+            return false;
+        }
     }
 
     // then re-read and open
-    HandleOutFile(false);
+    // a sequence run by this process is already in _sched, and in file up
+    //  to _fileIdx, so it is kept as is rather than parsed back
+    if (_schedDone && _filePtr && strategy->WritesSchedule())
+    {
+        _schedFailed = false;
+        _fileEnd = _fileIdx;
+        _fileIdx = 0;
+    }
+    else
+        HandleOutFile(false);
+
+    // prepare next scheduling sequence
+    // steps it repeats from the last one are left in file as they are
+    bool ret = strategy->Reset(_sched, _schedDone);
+    _fileShared = _fileEnd ?
+        std::min(strategy->SharedSteps(), _fileSteps.size()) : 0;
+    _fileSteps.resize(_fileShared);
+    _sched.clear();
+    _inReset = false;
+
+    // once there's nothing left to run, a process that ran sequences stops
+    //  running more, and one that ran none stops right away, as the
+    //  program would otherwise run without a schedule
+    if (!ret && _numRuns == 0)
+    {
+        GOV_ERR("%s - nothing left to run", _modeName.c_str());
+        error_abort();
+    }
+
+    _streakThreadId = SIZE_MAX;
+    _streakVisits.clear();
+    _livelockReported = false;
+
+    if (_traces)
+        _traces->Begin();
 
-    switch (_runMode)
+    return ret;
+}
+
+void Governor::EndSequence()
+{
+    HandleOutFile(true);
+    RecordTrace();
+    _strategy->End(_sched);
+
+    _numRuns++;
+    _sumDepth += _sched.size();
+    _maxDepth = std::max(_maxDepth, _sched.size());
+    if (_totals)
     {
-        case RUN_RANDOM:
-            // clear scheduling history
-            _schedIdx = 0;
-            _sched.clear();
-            break;
-        case RUN_EXPLORE:
-            // prepare next scheduling sequence
-            // next scheduling sequence uses same prefix, and uses
-            //  a different (higher) threadId at last possible option
-            // this is equivalent to a DFS search
-            _schedIdx = 0;
-            // if last execution wasn't complete, just repeat it
-            if (!_schedDone)
-                break;
-
-            while (!_sched.empty())
-            {
-                SchedPoint& sp = _sched.back();
-                if (sp.higher == 0)
-                {
-                    _sched.pop_back();
-                    continue;
-                }
+        _totals->runs.fetch_add(1);
+        _totals->steps.fetch_add(_sched.size());
+        size_t maxDepth = _totals->maxDepth.load();
+        while (maxDepth < _sched.size() &&
+            !_totals->maxDepth.compare_exchange_weak(maxDepth, _sched.size()))
+            ;
+    }
+    if (_coord)
+        _coord->AddRun();
 
-                // use the next threadId
-                // if it does not exist (i.e there's a gap), it will be corrected
-                //  at schedule time
-                sp.threadId += 1;
-                sp.higher -= 1;
-                break;
-            }
+    auto now = std::chrono::steady_clock::now();
+    if (_checkpointSecs && now - _lastCheckpoint >= std::chrono::seconds(_checkpointSecs))
+    {
+        WriteCheckpoint();
+        _lastCheckpoint = now;
+    }
+}
 
-            if (_sched.empty())
-            {
-                GOV_ERR("RUN_EXPLORE - reached last state");
-                std::abort();
-                return false;
-            }
+void Governor::RecordTrace()
+{
+    if (!_traces)
+        return;
 
-            break;
-        case RUN_PRESET:
+    bool unique = false;
+    uint64_t hash = _traces->End(unique);
+    if (!unique || _archiveDir.empty())
+        return;
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "/trace-%016" PRIx64, hash);
+    if (!WriteSchedule(_archiveDir + name, _sched))
+        GOV_ERR("failed to archive trace to %s", _archiveDir.c_str());
+}
+
+void Governor::WriteReport() const
+{
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - _startTime;
+    double secs = elapsed.count();
+
+    // the supervisor of worker processes reports the totals of all of them
+    // branching and traces are only in the workers' own reports
+    bool supervisor = _totals && _worker == SIZE_MAX;
+    size_t numRuns = supervisor ? _totals->runs.load() : _numRuns;
+    size_t numSteps = supervisor ? _totals->steps.load() : _numSteps;
+    size_t sumDepth = supervisor ? numSteps : _sumDepth;
+    size_t maxDepth = supervisor ? _totals->maxDepth.load() : _maxDepth;
+    size_t numSpinPrunes = supervisor ? _totals->spinPrunes.load() :
+        _numSpinPrunes;
+
+    // readers never see a partial report
+    bool ok = WriteFileAtomic(_reportPath, [&](FILE* f) {
+        fprintf(f, "{\n");
+        fprintf(f, "  \"mode\": \"%s\",\n", _modeName.c_str());
+        fprintf(f, "  \"schedules\": %lu,\n", numRuns);
+        if (_traces && !supervisor)
         {
-            bool firstSched = (_schedIdx == 0);
-            _schedIdx = 0; // be a good boy and reset _schedIdx
-            // and return false if we've already used the available sequence
-            return firstSched;
+            fprintf(f, "  \"unique_traces\": %lu,\n", _traces->NumNew());
+            fprintf(f, "  \"known_traces\": %lu,\n", _traces->NumUnique());
         }
-        default:
-            assert(false);
-            break;
+        else
+        {
+            fprintf(f, "  \"unique_traces\": null,\n");
+            fprintf(f, "  \"known_traces\": null,\n");
+        }
+        fprintf(f, "  \"failures\": %lu,\n", _numFailures);
+        fprintf(f, "  \"steps\": %lu,\n", numSteps);
+        fprintf(f, "  \"avg_depth\": %.3f,\n",
+            numRuns ? (double)sumDepth / numRuns : 0.0);
+        fprintf(f, "  \"max_depth\": %lu,\n", maxDepth);
+        fprintf(f, "  \"branching\": [");
+        for (size_t i = 0; i < _branchSum.size(); ++i)
+        {
+            fprintf(f, "%s%.3f", i ? ", " : "",
+                (double)_branchSum[i] / _branchCount[i]);
+        }
+        fprintf(f, "],\n");
+        fprintf(f, "  \"spin_prunes\": %lu,\n", numSpinPrunes);
+        fprintf(f, "  \"budget_exhausted\": %s,\n",
+            (supervisor ? BudgetReached() : _stopped) ? "true" : "false");
+        fprintf(f, "  \"wall_secs\": %.3f,\n", secs);
+        fprintf(f, "  \"steps_per_sec\": %.1f\n",
+            secs > 0.0 ? numSteps / secs : 0.0);
+        fprintf(f, "}\n");
+    });
+
+    if (!ok)
+        GOV_ERR("failed to write report to %s", _reportPath.c_str());
+}
+
+void Governor::WriteCheckpoint() const
+{
+    // synced, so that a complete checkpoint is kept even if the machine
+    //  goes down while writing
+    std::string path = _fileName + ".ckpt";
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - _startTime;
+
+    bool ok = WriteFileAtomic(path, [&](FILE* f) {
+        fprintf(f, "CHECKPOINT %s\n", _modeName.c_str());
+        fprintf(f, "runs %lu\n", _prevRuns + _numRuns);
+        fprintf(f, "failures %lu\n", _prevFailures + _numFailures);
+        fprintf(f, "secs %.0f\n", _prevSecs + elapsed.count());
+
+        char line[128];
+        for (SchedPoint sp : _sched)
+        {
+            if (sp.write(line, sizeof(line)))
+                std::fputs(line, f);
+        }
+        std::fputs("END\n", f);
+    }, true);
+
+    if (!ok)
+        GOV_ERR("failed to write checkpoint to %s", path.c_str());
+}
+
+bool Governor::ReadCheckpoint(std::vector<SchedPoint>& sched)
+{
+    std::string path = _fileName + ".ckpt";
+    FILE* f = std::fopen(path.c_str(), "r");
+    if (f == nullptr)
+        return false;
+
+    char mode[128];
+    size_t runs = 0, failures = 0;
+    double secs = 0.0;
+    bool valid = (std::fscanf(f, "CHECKPOINT %127s ", mode) == 1 &&
+        _modeName == mode &&
+        std::fscanf(f, "runs %lu ", &runs) == 1 &&
+        std::fscanf(f, "failures %lu ", &failures) == 1 &&
+        std::fscanf(f, "secs %lf ", &secs) == 1);
+
+    // then the sequence, which must end in END
+    char line[128];
+    bool ended = false;
+    sched.clear();
+    while (valid && !ended && std::fgets(line, sizeof(line), f))
+    {
+        SchedPoint sp;
+        if (std::strcmp(line, "END\n") == 0)
+            ended = true;
+        else if (sp.read(line) && sp.higher < sp.available)
+            sched.push_back(sp);
+        else
+            valid = false;
     }
 
+    std::fclose(f);
+    if (!valid || !ended)
+    {
+        GOV_ERR("ignoring invalid checkpoint %s", path.c_str());
+        sched.clear();
+        return false;
+    }
+
+    _prevRuns = runs;
+    _prevFailures = failures;
+    _prevSecs = secs;
+    return true;
+}
+
+bool Governor::BudgetReached() const
+{
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - _startTime;
+
+    // workers share the run budget
+    size_t numRuns = _totals ? _totals->runs.load() : _numRuns;
+    return (_budgetRuns && numRuns >= _budgetRuns) ||
+        (_budgetSecs && elapsed.count() >= _budgetSecs);
+}
+
+bool Governor::BudgetExhausted() const
+{
+    if (!BudgetReached())
+        return false;
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - _startTime;
+    fprintf(stderr, "%s - budget exhausted, %lu schedules run in %.0fs\n",
+        _modeName.c_str(), _numRuns, elapsed.count());
+    if (_spinLimit)
+        fprintf(stderr, "%s - spinning threads deprioritized %lu times\n",
+            _modeName.c_str(), _numSpinPrunes);
     return true;
 }
 
 void Governor::Prepare(size_t numThreads)
 {
+    Start();
+
     std::lock_guard<std::mutex> lock(_mutex);
 
+    // threads expected by a launch group would be miscounted, see Launch()
+    if (_launching || _launchedToSub)
+    {
+        GOV_ERR("GOV_PREPARE() called while gov::threads are launched");
+        error_abort();
+    }
+
     _threadsToSub = numThreads;
 }
 
-void Governor::Subscribe(size_t threadId)
+size_t Governor::Launch()
+{
+    Start();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // threads launched until EndLaunch() form a group, numbered from 0
+    // only one group runs at a time, and not along with threads expected
+    //  by Prepare(), as their ids and _threadsToSub would clash
+    if (!_launching)
+    {
+        if (!_threads.empty() || _threadsToSub)
+        {
+            GOV_ERR("gov::thread launched while %lu threads are subscribed "
+                "and %lu expected to, from an earlier group or "
+                "GOV_PREPARE()", _threads.size(), _threadsToSub);
+            error_abort();
+        }
+
+        _launching = true;
+        _launchedToSub = true;
+        _numLaunched = 0;
+    }
+
+    _threadsToSub++;
+    return _numLaunched++;
+}
+
+void Governor::EndLaunch()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (!_launching)
+        return;
+
+    _launching = false;
+    if (_threadsToSub == 0)
+        _launchedToSub = false;
+
+    // all threads may be waiting at control points already
+    UpdateActiveThread();
+}
+
+void Governor::Start()
+{
+    std::call_once(_initFlag, &Governor::Init, this);
+    _current = this;
+
+    // first call forks workers, if the strategy runs sequences in them
+    // this is done before any thread subscribes
+    // forking would leave other domains' threads behind, so only the
+    //  default governor can do it
+    if (!_supervised && _strategy && _strategy->NumWorkers())
+    {
+        if (!_domain.empty())
+        {
+            GOV_ERR("%s - can't run worker processes in domain %s",
+                _modeName.c_str(), _domain.c_str());
+            error_abort();
+        }
+
+        _supervised = true;
+        Supervise();
+    }
+}
+
+void Governor::Subscribe(size_t threadId, size_t symClass /*= NO_SYMMETRY*/)
 {
+    std::call_once(_initFlag, &Governor::Init, this);
+    _current = this;
+
     std::lock_guard<std::mutex> lock(_mutex);
 
+    // fail early if GOV_MODE does not name a known strategy
+    GetStrategy();
+
     // check if thread is already subbed
     if (GetThreadState())
     {
         GOV_ERR("thread %lu already subbed", threadId);
-        std::abort();
+        error_abort();
         return;
     }
     // check if thread is supposed to be able to sub
     if (_threadsToSub == 0)
     {
         GOV_ERR("no more threads were expected to sub");
-        std::abort();
+        error_abort();
         return;
     }
     // check if user provided an unused thread id
-    for (auto p : _threads)
+    if (_threadIds.count(threadId))
     {
-        ThreadState* state = p.second;
-        if (state->threadId == threadId)
-        {
-            GOV_ERR("threadId %lu provided is already used", threadId);
-            std::abort();
-            return;
-        }
+        GOV_ERR("threadId %lu provided is already used", threadId);
+        error_abort();
+        return;
     }
 
     // update affinity, thread should only use a specific cpu
@@ -264,12 +791,14 @@ void Governor::Subscribe(size_t threadId)
 
     // init thread state data
     std::thread::id id = std::this_thread::get_id();
-    ThreadState* state = new ThreadState(threadId);
+    ThreadState* state = new ThreadState(threadId, symClass);
 
     _threads[id] = state;
     _threadIds[state->threadId] = id;
     // decrement expected number of subbed threads
     _threadsToSub--;
+    if (_threadsToSub == 0 && !_launching)
+        _launchedToSub = false;
 
     assert(GetThreadState() == state);
     assert(_threads.size() == _threadIds.size());
@@ -286,6 +815,9 @@ void Governor::Unsubscribe()
     if (GetThreadState() == nullptr)
         return;
 
+    // the thread may be reused for another domain
+    _current = nullptr;
+
     // update affinity, after unsub thread can use all cpus
     //SetAffinity(false);
 
@@ -304,8 +836,20 @@ void Governor::Unsubscribe()
     UpdateActiveThread();
 }
 
-void Governor::ControlPoint()
+void Governor::ControlPoint(const char* file /*= nullptr*/, int line /*= 0*/,
+    const char* func /*= nullptr*/, const void* addr /*= nullptr*/,
+    AccessKind access /*= ACCESS_UNKNOWN*/)
 {
+    // filtered out sites are not scheduling points, so the running thread
+    //  just continues past them
+    // this is checked before taking the lock, as most sites may be filtered
+    // any other thread, i.e. one that hasn't been chosen to run yet, still
+    //  waits for its turn here, or it would run alongside the chosen one
+    if ((!_sitesInclude.empty() || !_sitesExclude.empty()) &&
+        _activeThreadId.load() == std::this_thread::get_id() &&
+        !SiteAllowed(file, line, func))
+        return;
+
     std::unique_lock<std::mutex> lock(_mutex);
 
     ThreadState* state = GetThreadState();
@@ -315,6 +859,10 @@ void Governor::ControlPoint()
 
     // mark thread as being in a control point
     state->isInControlPoint = true;
+    state->site = GetSiteId(file, line);
+    _threadSite = state->site;
+    state->addr = addr;
+    state->access = access;
 
     // and then (possibly) choose a new thread to execute
     UpdateActiveThread();
@@ -328,6 +876,44 @@ void Governor::ControlPoint()
         std::this_thread::yield();
 }
 
+void Governor::RegisterStrategy(const char* name, Strategy* strategy)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    if (_strategies.find(name) != _strategies.end())
+    {
+        GOV_ERR("strategy %s is already registered", name);
+        error_abort();
+    }
+
+    _strategies[name].reset(strategy);
+
+    // use it if it's the strategy GOV_MODE refers to
+    if (_strategy || _modeName != name)
+        return;
+
+    _strategy = strategy;
+    // otherwise it's set up along with the rest, at first use
+    if (!_initialized)
+        return;
+
+    lock.unlock();
+    // read/open seq file
+    Reset(true);
+}
+
+Strategy* Governor::GetStrategy() const
+{
+    if (_strategy == nullptr)
+    {
+        GOV_ERR("invalid GOV_MODE variable %s, no such strategy registered",
+            _modeName.c_str());
+        error_abort();
+    }
+
+    return _strategy;
+}
+
 ThreadState* Governor::GetThreadState() const
 {
     std::thread::id id = std::this_thread::get_id();
@@ -338,15 +924,124 @@ ThreadState* Governor::GetThreadState() const
     return nullptr;
 }
 
+// site ids are derived from the file name contents and line, so they're
+//  stable across runs
+static size_t HashFile(const char* file)
+{
+    // FNV-1a
+    size_t hash = 14695981039346656037ul;
+    for (const char* c = file; *c; ++c)
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ul;
+
+    return hash;
+}
+
+static size_t MakeSiteId(size_t fileHash, int line)
+{
+    size_t id = fileHash ^ ((size_t)line * 0x9E3779B97F4A7C15ul);
+    return id ? id : 1;
+}
+
+size_t Governor::GetSiteId(const char* file, int line)
+{
+    if (file == nullptr)
+        return 0;
+
+    // file names are string literals, so hash each one just once
+    auto itr = _fileHashes.find(file);
+    if (itr == _fileHashes.end())
+        itr = _fileHashes.emplace(file, HashFile(file)).first;
+
+    return MakeSiteId(itr->second, line);
+}
+
+bool Governor::SiteAllowed(const char* file, int line, const char* func)
+{
+    // file and func are string literals, so sites are cached by address
+    // cache is per thread, so no locking is needed
+    struct SiteHash
+    {
+        size_t operator()(std::pair<const char*, int> const& p) const
+        {
+            return std::hash<const char*>()(p.first) ^ (size_t)p.second;
+        }
+    };
+    thread_local std::unordered_map<std::pair<const char*, int>, bool,
+        SiteHash> allowedCache;
+
+    auto key = std::make_pair(file, line);
+    auto itr = allowedCache.find(key);
+    if (itr != allowedCache.end())
+        return itr->second;
+
+    bool allowed =
+        (_sitesInclude.empty() || SiteMatches(_sitesInclude, file, line, func)) &&
+        !SiteMatches(_sitesExclude, file, line, func);
+
+    allowedCache.emplace(key, allowed);
+    return allowed;
+}
+
+bool Governor::SiteMatches(std::vector<std::string> const& patterns,
+    const char* file, int line, const char* func)
+{
+    // sites without location info match nothing
+    if (file == nullptr)
+        return false;
+
+    // a file pattern matches the full path or its trailing components
+    auto fileMatches = [file](std::string const& pattern) -> bool {
+        size_t len = std::strlen(file);
+        if (pattern.size() > len ||
+            pattern.compare(0, std::string::npos,
+                file + len - pattern.size()) != 0)
+            return false;
+
+        return pattern.size() == len || file[len - pattern.size() - 1] == '/';
+    };
+
+    // called without holding the lock, so the file hash cache can't be used
+    std::string siteId = std::to_string(MakeSiteId(HashFile(file), line));
+    for (std::string const& pattern : patterns)
+    {
+        // function name, or site id as printed in FAIL markers
+        if ((func && pattern == func) || pattern == siteId)
+            return true;
+
+        // file:line
+        size_t colon = pattern.rfind(':');
+        if (colon != std::string::npos && colon + 1 < pattern.size() &&
+            std::all_of(pattern.begin() + colon + 1, pattern.end(), ::isdigit))
+        {
+            // line numbers too large to parse match no site
+            errno = 0;
+            unsigned long patternLine =
+                std::strtoul(pattern.c_str() + colon + 1, nullptr, 10);
+            if (errno != ERANGE && line >= 0 &&
+                patternLine == (unsigned long)line &&
+                fileMatches(pattern.substr(0, colon)))
+                return true;
+
+            continue;
+        }
+
+        // file
+        if (fileMatches(pattern))
+            return true;
+    }
+
+    return false;
+}
+
 bool Governor::UpdateActiveThread()
 {
     std::thread::id id = std::this_thread::get_id();
     if (_activeThreadId.load() == id)
         _activeThreadId.store(std::thread::id());
 
-    // not all threads have subscribed yet, so can't schedule
-    //  a running thread yet
-    if (_threadsToSub)
+    // not all threads have subscribed (or been launched) yet, so can't
+    //  schedule a running thread yet
+    if (_threadsToSub || _launching)
         return false;
 
     // check if we can choose a new thread to execute
@@ -363,143 +1058,294 @@ bool Governor::UpdateActiveThread()
     if (_threads.empty())
         return false;
 
-    std::thread::id threadToRun = ChooseThread(_runMode);
+    std::thread::id threadToRun = ChooseThread();
 
     // launch choosen thread
     ThreadState* state = _threads[threadToRun];
     state->isInControlPoint = false;
+    state->steps++;
 
     _activeThreadId.store(threadToRun);
     return true;
 }
 
-std::thread::id Governor::ChooseThread(RunMode mode)
+std::thread::id Governor::ChooseThread()
 {
     assert(!_threads.empty());
     assert(!_threadIds.empty());
 
-    SchedPoint sp;
-    // choose a random thread of the available ones
-    if (mode == RUN_RANDOM)
-    {
-        std::vector<size_t> available;
-        for (auto p : _threadIds)
-            available.push_back(p.first);
-
-        std::shuffle(available.begin(), available.end(), _rng);
-        sp.threadId = available.front();
-        sp.available = available.size();
-        sp.higher = std::count_if(_threadIds.begin(), _threadIds.end(),
-            [&sp](std::pair<size_t, std::thread::id> p)
-        {
-            return p.first > sp.threadId;
-        });
-
-        _sched.push_back(sp);
-        _schedIdx = _sched.size() - 1;
-    }
-    else if (mode == RUN_EXPLORE)
+    // gather threads that can be run
+    // of the symmetric threads that haven't run yet, only the one with the
+    //  lowest threadId in each class is runnable, as choosing any other
+    //  leads to a permutation of the same states
+    _runnable.clear();
+    _runnableSites.clear();
+    _unstartedClasses.clear();
+    for (auto p : _threadIds)
     {
-        size_t idx = _schedIdx++;
-        assert(idx <= _sched.size());
-
-        // if there's no info in schedule, use first available threadId
-        if (idx == _sched.size())
+        ThreadState* state = _threads[p.second];
+        if (state->symClass != NO_SYMMETRY && state->steps == 0)
         {
-            auto itr = _threadIds.begin();
-            sp.threadId = itr->first;
-            sp.available = _threadIds.size();
-            sp.higher = sp.available - 1;
-            _sched.push_back(sp);
+            if (std::find(_unstartedClasses.begin(), _unstartedClasses.end(),
+                state->symClass) != _unstartedClasses.end())
+                continue;
+
+            _unstartedClasses.push_back(state->symClass);
         }
 
-        assert(idx < _sched.size());
-        sp = _sched[idx];
+        _runnable.push_back(p.first);
+        _runnableSites.push_back(state->site);
+    }
 
-        // last point in known schedule
-        // this point was generated by adding 1 to last threadId,
-        //  so the threadId might not exist, and we need to ensure
-        //  that it does
-        if (idx == _sched.size() - 1)
+    // bounded fairness
+    // a thread that was run too many times at the same site without any
+    //  other thread running is likely spinning, waiting for another thread
+    // so it is not runnable until some other thread runs
+    if (_spinLimit && _streakThreadId != SIZE_MAX)
+    {
+        auto itr = std::lower_bound(_runnable.begin(), _runnable.end(),
+            _streakThreadId);
+        if (itr != _runnable.end() && *itr == _streakThreadId)
         {
-            // use first threadId that is >= indicated threadId
-            for (auto p : _threadIds)
+            size_t idx = itr - _runnable.begin();
+            if (_streakVisits[_runnableSites[idx]] >= _spinLimit)
             {
-                size_t threadId = p.first;
-                if (threadId >= sp.threadId)
+                if (_runnable.size() > 1)
                 {
-                    sp.threadId = threadId;
-                    break;
+                    _runnable.erase(itr);
+                    _runnableSites.erase(_runnableSites.begin() + idx);
+                    _numSpinPrunes++;
+                    if (_totals)
+                        _totals->spinPrunes.fetch_add(1);
+                }
+                else if (!_livelockReported)
+                {
+                    // nobody else can make progress
+                    GOV_ERR("%s - possible livelock, threadId %lu ran %lu "
+                        "times at the same site at step %lu",
+                        _modeName.c_str(), _streakThreadId,
+                        _streakVisits[_runnableSites[idx]], _sched.size());
+                    _livelockReported = true;
                 }
             }
         }
     }
-    else if (mode == RUN_PRESET)
+
+    StepContext ctx = { _sched.size(), _runnable, _runnableSites };
+
+    SchedPoint sp;
+    sp.threadId = _strategy->Choose(ctx);
+
+    auto itr = std::lower_bound(_runnable.begin(), _runnable.end(),
+        sp.threadId);
+    if (itr == _runnable.end() || *itr != sp.threadId)
+    {
+        GOV_ERR("%s - chose invalid threadId %lu at step %lu",
+            _modeName.c_str(), sp.threadId, ctx.step);
+        error_abort();
+    }
+
+    sp.available = _runnable.size();
+    sp.higher = _runnable.end() - itr - 1;
+
+    // branching factor at each depth
+    _numSteps++;
+    if (_branchSum.size() <= ctx.step)
     {
-        size_t idx = _schedIdx++;
-        if (idx >= _sched.size())
+        _branchSum.resize(ctx.step + 1, 0);
+        _branchCount.resize(ctx.step + 1, 0);
+    }
+    _branchSum[ctx.step] += sp.available;
+    _branchCount[ctx.step]++;
+
+    _sched.push_back(sp);
+    _lastSite = _runnableSites[itr - _runnable.begin()];
+
+    if (_traces)
+    {
+        ThreadState* state = _threads[_threadIds[sp.threadId]];
+        _traces->Step(sp.threadId, _lastSite, state->addr, state->access);
+    }
+
+    // track sites visited by the thread since another thread last ran
+    if (_spinLimit)
+    {
+        if (sp.threadId != _streakThreadId)
         {
-            GOV_ERR("RUN_PRESET - no scheduling available at idx %lu", idx);
-            std::abort();
-            return ChooseThread(RUN_RANDOM);
+            _streakThreadId = sp.threadId;
+            _streakVisits.clear();
         }
 
-        sp = _sched[idx];
+        _streakVisits[_lastSite]++;
+    }
 
-        auto itr = _threadIds.find(sp.threadId);
-        if (itr == _threadIds.end())
+    if (_filePtr && _strategy->WritesSchedule())
+    {
+        // steps the strategy repeats from the last sequence are left in
+        //  file as they are
+        if (ctx.step < _fileShared)
         {
-            GOV_ERR("RUN_PRESET - threadId %lu is invalid at line %lu",
-                sp.threadId, idx + 1);
-            std::abort();
-            return ChooseThread(RUN_RANDOM);
+            _fileIdx = _fileSteps[ctx.step];
+            return _threadIds[sp.threadId];
         }
 
-        if (sp.available != _threadIds.size())
+        // other steps shared with it are also already in file
+        char line[128];
+        size_t len = sp.write(line, sizeof(line));
+        if (_fileIdx + len <= _fileEnd &&
+            std::memcmp(&_filePtr[_fileIdx], line, len) == 0)
         {
-            GOV_ERR("RUN_PRESET - wrong available value (%lu vs %lu) at "
-                "line %lu", sp.available, _threadIds.size(), idx + 1);
-            std::abort();
-            return ChooseThread(RUN_RANDOM);
+            _fileIdx += len;
         }
-
-        size_t higher = std::count_if(_threadIds.begin(), _threadIds.end(),
-            [&sp](std::pair<size_t, std::thread::id> p)
+        else
         {
-            return p.first > sp.threadId;
-        });
+            // the rest of the last sequence is cleared before writing, so
+            //  that the file never holds a mix of both
+            ClearFileEnd();
 
-        if (sp.higher != higher)
-        {
-            GOV_ERR("RUN_PRESET - wrong higher value (%lu vs %lu) at "
-                "line %lu", sp.higher, higher, idx + 1);
-            std::abort();
-            return ChooseThread(RUN_RANDOM);
+            // write sp to file
+            while (true)
+            {
+                len = sp.write(&_filePtr[_fileIdx], _fileSize - _fileIdx);
+                if (_fileIdx + len < _fileSize)
+                {
+                    _fileIdx += len;
+                    break;
+                }
+
+                // double size of file
+                MapFileToMem(_fileSize * 2);
+            }
         }
+
+        _fileSteps.push_back(_fileIdx);
     }
 
-    auto itr = _threadIds.find(sp.threadId);
-    assert(itr != _threadIds.end());
-    std::thread::id id = itr->second;
+    return _threadIds[sp.threadId];
+}
 
-    if (_filePtr && (_runMode == RUN_RANDOM || _runMode == RUN_EXPLORE))
+void Governor::Supervise()
+{
+    size_t numWorkers = _strategy->NumWorkers();
+    std::vector<pid_t> pids(numWorkers, 0);
+    size_t numAlive = 0;
+    size_t numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // run budget is shared by all workers, and so are statistics, for
+    //  the report of the campaign
+    void* ptr = mmap(nullptr, sizeof(WorkerTotals),
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
     {
-        // write sp to file
-        while (true)
+        GOV_ERR("failed to map shared memory");
+        error_abort();
+    }
+    _totals = new (ptr) WorkerTotals();
+
+    // returns true in the new worker
+    auto spawn = [&](size_t worker) -> bool {
+        // so buffered output isn't written by both processes
+        fflush(stdout);
+        fflush(stderr);
+
+        pid_t pid = fork();
+        if (pid == -1)
         {
-            size_t len = sp.write(&_filePtr[_fileIdx], _fileSize - _fileIdx);
-            if (_fileIdx + len < _fileSize)
+            GOV_ERR("%s - failed to fork worker %lu", _modeName.c_str(), worker);
+            return false;
+        }
+
+        if (pid == 0)
+        {
+            _worker = worker;
+
+            // each worker runs on its own core, if there are enough
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(worker % numCPUs, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+
+            // and writes its own schedule file
+            if (_filePtr && _strategy->WritesSchedule())
             {
-                _fileIdx += len;
-                break;
+                munmap(_filePtr, _fileSize);
+                _filePtr = nullptr;
+                close(_fileDesc);
+
+                _fileName += "." + std::to_string(worker);
+                OpenFile();
+                MapFileToMem(PAGE);
+                std::memset(_filePtr, 0x0, _fileSize);
+                _fileIdx = 0;
+                _fileEnd = 0;
+                _fileShared = 0;
+                _fileSteps.clear();
             }
 
-            // double size of file
-            MapFileToMem(_fileSize * 2);
+            // and report, the campaign's is written by the supervisor
+            if (!_reportPath.empty())
+                _reportPath += "." + std::to_string(worker);
+
+            _strategy->StartWorker(worker);
+            return true;
+        }
+
+        pids[worker] = pid;
+        numAlive++;
+        return false;
+    };
+
+    auto hasWork = [this]() -> bool {
+        return _strategy->HasWork() && !BudgetReached();
+    };
+
+    for (size_t worker = 0; worker < numWorkers && hasWork(); ++worker)
+    {
+        if (spawn(worker))
+            return;
+    }
+
+    // replace workers as they exit, while there's work left
+    while (numAlive)
+    {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            GOV_ERR("%s - waitpid failed", _modeName.c_str());
+            break;
         }
+
+        auto itr = std::find(pids.begin(), pids.end(), pid);
+        if (itr == pids.end())
+            continue;
+
+        size_t worker = itr - pids.begin();
+        *itr = 0;
+        numAlive--;
+
+        // workers that crash, or exit with an error, ran a failed sequence
+        if (WIFSIGNALED(status) ||
+            (WIFEXITED(status) && WEXITSTATUS(status) != 0))
+            _numFailures++;
+
+        _strategy->WorkerExited(worker, pid, status);
+        if (hasWork() && spawn(worker))
+            return;
     }
 
-    return id;
+    // the program itself is only run by workers
+    fprintf(stderr, "%s - %lu schedules run by workers\n",
+        _modeName.c_str(), _totals->runs.load());
+    int ret = _strategy->Finish(stderr);
+    if (!_reportPath.empty())
+        WriteReport();
+    fflush(stdout);
+    fflush(stderr);
+    std::_Exit(ret);
 }
 
 void Governor::SetAffinity(bool apply)
@@ -539,8 +1385,11 @@ void Governor::HandleOutFile(bool close)
 {
     if (close)
     {
-        if (_filePtr && (_runMode == RUN_RANDOM || _runMode == RUN_EXPLORE))
+        if (_filePtr && _strategy->WritesSchedule())
         {
+            // drop the rest of the last sequence, if this one is shorter
+            ClearFileEnd();
+
             // write "END" to file
             while (true)
             {
@@ -559,15 +1408,17 @@ void Governor::HandleOutFile(bool close)
         return;
     }
 
-    // read last sequence, depending on mode
-    if (_runMode == RUN_EXPLORE || _runMode == RUN_PRESET)
+    // read last sequence, depending on strategy
+    _fileEnd = 0;
+    if (_strategy->ReadsSchedule())
     {
         if (_filePtr == nullptr)
         {
-            if (_runMode == RUN_PRESET)
+            if (!_strategy->WritesSchedule())
             {
-                GOV_ERR("mode is RUN_PRESET but can't read %s file", GOV_FILE);
-                std::abort();
+                GOV_ERR("mode is %s but can't read %s file",
+                    _modeName.c_str(), _fileName.c_str());
+                error_abort();
             }
         }
         else
@@ -575,25 +1426,70 @@ void Governor::HandleOutFile(bool close)
             // read sched
             _fileIdx = 0;
             _sched.clear();
+            _fileSteps.clear();
             SchedPoint tmp;
             size_t ret;
             while ((ret = tmp.read(&_filePtr[_fileIdx])))
             {
                 _sched.push_back(tmp);
                 _fileIdx += ret;
+                _fileSteps.push_back(_fileIdx);
             }
 
             // then check if schedule reached end of program
             int nchars = 0;
             std::sscanf(&_filePtr[_fileIdx], "END\n%n", &nchars);
             _schedDone = (nchars > 0);
+
+            // or if the program crashed while running it
+            // a failed sequence is also done, it should not be repeated
+            int sig = 0;
+            size_t site = 0;
+            _schedFailed = (std::sscanf(&_filePtr[_fileIdx], "FAIL %d %lu",
+                &sig, &site) >= 1);
+            _schedDone = _schedDone || _schedFailed;
+
+            // on the first read, resume from the checkpoint unless the file
+            //  holds a complete, well-formed sequence
+            // a process killed while running leaves it incomplete, and one
+            //  that lost the machine may leave it truncated or mangled
+            bool valid = true;
+            for (SchedPoint const& sp : _sched)
+                valid = valid && sp.higher < sp.available;
+            std::vector<SchedPoint> ckpt;
+            if (_checkpointSecs && _numRuns == 0 && ReadCheckpoint(ckpt) &&
+                !(valid && _schedDone))
+            {
+                fprintf(stderr, "%s - %s is incomplete, resuming from "
+                    "checkpoint, %lu schedules run before\n",
+                    _modeName.c_str(), _fileName.c_str(), _prevRuns);
+                _sched = ckpt;
+                _schedDone = true;
+                _schedFailed = false;
+            }
+            else
+            {
+                // the sequence just read stays in file, for the next one
+                //  to only rewrite it from the first step it differs in
+                _fileEnd = _fileIdx + strnlen(&_filePtr[_fileIdx],
+                    _fileSize - _fileIdx);
+            }
+            _numFailures += _schedFailed;
+
+            if (_schedFailed && _stopOnFail)
+            {
+                // leave file untouched, it has the failing sequence
+                GOV_ERR("%s - last sequence in %s failed with signal %d, "
+                    "stopping", _modeName.c_str(), _fileName.c_str(), sig);
+                std::_Exit(EXIT_FAILURE);
+            }
         }
     }
 
     // then prepare file for writing
     // don't need to write schedule when in RUN_PRESET
     // it is already present
-    if (_filePtr && (_runMode == RUN_RANDOM || _runMode == RUN_EXPLORE))
+    if (_filePtr && _strategy->WritesSchedule() && _fileEnd == 0)
     {
         // reset file size
         MapFileToMem(PAGE); // to a single page
@@ -605,6 +1501,135 @@ void Governor::HandleOutFile(bool close)
     _fileIdx = 0;
 }
 
+void Governor::ClearFileEnd()
+{
+    if (_fileEnd > _fileIdx)
+        std::memset(&_filePtr[_fileIdx], 0x0, _fileEnd - _fileIdx);
+
+    _fileEnd = 0;
+}
+
+// async-signal-safe helpers to format crash info
+static size_t AppendStr(char* buffer, size_t idx, size_t size, const char* str)
+{
+    while (*str && idx + 1 < size)
+        buffer[idx++] = *str++;
+
+    buffer[idx] = '\0';
+    return idx;
+}
+
+static size_t AppendNum(char* buffer, size_t idx, size_t size, size_t num)
+{
+    char digits[32];
+    size_t n = 0;
+    do
+    {
+        digits[n++] = '0' + (num % 10);
+        num /= 10;
+    } while (num);
+
+    while (n && idx + 1 < size)
+        buffer[idx++] = digits[--n];
+
+    buffer[idx] = '\0';
+    return idx;
+}
+
+void Governor::HandleCrash(int sig)
+{
+    // only the first crashing thread saves the sequence
+    static std::atomic<bool> handled(false);
+    if (handled.exchange(true))
+        return;
+
+    // nothing to save if no sequence is being written
+    // crashes inside Reset() are governor errors, not program failures
+    if (_filePtr == nullptr || _strategy == nullptr ||
+        !_strategy->WritesSchedule() || _sched.empty() || _inReset)
+        return;
+
+    // drop the rest of the last sequence, see ChooseThread()
+    for (size_t i = _fileIdx; i < _fileEnd; ++i)
+        _filePtr[i] = '\0';
+
+    // mark sequence as failed, with signal and site of the last control
+    //  point the crashing thread reached (not that of the last thread
+    //  chosen to run, which may be another one), so failures are told
+    //  apart by where they happen
+    // pwrite is used as the marker may not fit in the mapped file
+    char marker[64];
+    size_t len = AppendStr(marker, 0, sizeof(marker), "FAIL ");
+    len = AppendNum(marker, len, sizeof(marker), sig);
+    len = AppendStr(marker, len, sizeof(marker), " ");
+    len = AppendNum(marker, len, sizeof(marker), _threadSite);
+    len = AppendStr(marker, len, sizeof(marker), "\n");
+    if (pwrite(_fileDesc, marker, len, _fileIdx) != (ssize_t)len)
+        return;
+
+    if (_coord)
+        _coord->AddFailure();
+    // failed sequences count towards the workers' run budget
+    if (_totals)
+    {
+        _totals->runs.fetch_add(1);
+        _totals->steps.fetch_add(_sched.size());
+    }
+
+    // and keep a copy named after the process, as the schedule file is
+    //  overwritten by the next run
+    char path[256];
+    size_t pathLen = AppendStr(path, 0, sizeof(path), _fileName.c_str());
+    pathLen = AppendStr(path, pathLen, sizeof(path), ".fail.");
+    AppendNum(path, pathLen, sizeof(path), getpid());
+
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC,
+        S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd == -1)
+        return;
+
+    bool ok = write(fd, _filePtr, _fileIdx) == (ssize_t)_fileIdx &&
+        write(fd, marker, len) == (ssize_t)len;
+    close(fd);
+
+    if (ok)
+    {
+        char msg[320];
+        size_t msgLen = AppendStr(msg, 0, sizeof(msg), "governor: signal ");
+        msgLen = AppendNum(msg, msgLen, sizeof(msg), sig);
+        msgLen = AppendStr(msg, msgLen, sizeof(msg), ", failing sequence saved to ");
+        msgLen = AppendStr(msg, msgLen, sizeof(msg), path);
+        msgLen = AppendStr(msg, msgLen, sizeof(msg), "\n");
+        if (write(STDERR_FILENO, msg, msgLen)) { }
+    }
+}
+
+void Governor::OpenFile()
+{
+    // open schedule file
+    _fileDesc = open(_fileName.c_str(), O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    if (_fileDesc == -1)
+    {
+        GOV_ERR("failed to open or create %s", _fileName.c_str());
+        error_abort();
+    }
+
+    // get size of file, in multiples of page
+    if (_fileDesc != -1)
+    {
+        struct stat st;
+        fstat(_fileDesc, &st);
+        _fileSize = (st.st_size / PAGE) * PAGE + ((st.st_size % PAGE) ? PAGE : 0);
+        // init file with at least 1 page of storage
+        if (_fileSize == 0)
+            _fileSize = PAGE;
+
+        // map file into memory
+        MapFileToMem(_fileSize);
+    }
+}
+
 void Governor::MapFileToMem(size_t size)
 {
     if (_fileDesc == -1)
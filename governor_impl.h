@@ -24,6 +24,8 @@
 #include <sched.h>
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstdint>
 
 #include <vector>
 #include <map>
@@ -33,39 +35,46 @@
 #include <thread>
 #include <fstream>
 #include <random>
+#include <memory>
+#include <string>
+#include <chrono>
 
-enum RunMode
-{
-    // use random scheduling
-    RUN_RANDOM      = 0,
-    // use ordered scheduling, data is kept in file in execution dir (.gov)
-    RUN_EXPLORE     = 1,
-    // assume a valid schedule is saved in .gov, and run it (once)
-    RUN_PRESET      = 2,
-};
+#include "governor_strategy.h"
+#include "governor_trace.h"
+#include "governor_coord.h"
+#include "governor_hooks.h"
 
-// contains info stored at each scheduling point
-struct SchedPoint
-{
-public:
-    size_t threadId; // thread id to be run
-    size_t available; // number of threads that were available to be run
-    size_t higher; // number of threads with threadId higher than `threadId`
+#define GOV_ERR(str, ...) \
+    fprintf(stderr, "%s:%d %s " str "\n", __FILE__, \
+            __LINE__, __func__, ##__VA_ARGS__);
 
-public:
-    // read/write using a char buffer
-    // buffer can be assumed to have at least one ending \0
-    size_t read(char* buffer);
-    // size describes buffer size
-    size_t write(char* buffer, size_t size);
-};
+// symmetry class of threads that are not interchangeable with any other
+constexpr size_t NO_SYMMETRY = SIZE_MAX;
 
 struct ThreadState
 {
     size_t const threadId; // user-provided thread id
+    // threads in the same symmetry class run the same code on the same
+    //  inputs, so they're interchangeable until they are first scheduled
+    size_t const symClass;
     bool isInControlPoint = false;
+    size_t site = 0; // id of control point site thread is in, 0 if unknown
+    size_t steps = 0; // number of times thread was scheduled
+    // access the thread performs once it leaves the control point
+    const void* addr = nullptr;
+    AccessKind access = ACCESS_UNKNOWN;
 
-    ThreadState(size_t t) : threadId(t) { }
+    ThreadState(size_t t, size_t c) : threadId(t), symClass(c) { }
+};
+
+// totals of the sequences run by all worker processes, kept in memory
+//  shared with them, see Governor::Supervise()
+struct WorkerTotals
+{
+    std::atomic<size_t> runs;
+    std::atomic<size_t> steps; // of all sequences, including failed ones
+    std::atomic<size_t> maxDepth;
+    std::atomic<size_t> spinPrunes;
 };
 
 class Governor
@@ -81,77 +90,270 @@ public:
     // after calling Prepare(N), N distinct threads must call Subscribe()
     //  before scheduling at a control point can occur
     void Prepare(size_t numThreads);
+    // same as Prepare(), for threads launched one at a time
+    // each call expects one more thread, and returns the threadId it must
+    //  subscribe with, in launch order
+    // scheduling waits until EndLaunch() is called
+    // aborts if threads of an earlier group, or expected by Prepare(),
+    //  haven't all subscribed and unsubscribed
+    size_t Launch();
+    void EndLaunch();
     // subscribe a thread for scheduling
     // after subscribing, and until it unsubs, the thread must *NEVER*
     //  depend on the progress of another (i.e. use locks, joins())
     // all operations that read/write to shared state must call ControlPoint()
     //  before performing the read/write
-    void Subscribe(size_t threadId);
+    // threads with the same symClass must be interchangeable (same code and
+    //  inputs), and only one of their permutations is scheduled
+    void Subscribe(size_t threadId, size_t symClass = NO_SYMMETRY);
     // unsubscribe calling thread from scheduling
     // has no effect if thread is not subscribed
     void Unsubscribe();
     // give control to governor, only has effect after thread is subscribed
-    void ControlPoint();
+    // file, line and func optionally identify the control point site
+    // sites excluded by GOV_SITES_INCLUDE/GOV_SITES_EXCLUDE are ignored
+    // addr and access describe the shared memory access that follows the
+    //  control point, used to tell equivalent traces apart
+    void ControlPoint(const char* file = nullptr, int line = 0,
+        const char* func = nullptr, const void* addr = nullptr,
+        AccessKind access = ACCESS_UNKNOWN);
+    // save the sequence being run as failed, called on fatal signals
+    // must be async-signal-safe
+    void HandleCrash(int sig);
+    // register a scheduling strategy, used if GOV_MODE is `name`
+    // governor takes ownership of the strategy
+    void RegisterStrategy(const char* name, Strategy* strategy);
 
 public:
-    static Governor* instance()
+    // default governor, which threads use unless they use a domain
+    // it's constructed once at startup, see initializer(), and destroyed
+    //  at exit
+    static void CreateDefault();
+
+    // aborts if the default governor is used once destroyed (e.g. by a
+    //  thread still running at exit), or before it is constructed
+    static Governor* Default()
     {
-        static Governor instance;
-        return &instance;
+        Governor* governor = _default.load(std::memory_order_acquire);
+        if (governor == nullptr)
+        {
+            GOV_ERR("default governor used outside of its lifetime");
+            error_abort();
+        }
+
+        return governor;
+    }
+
+    // independent governors, with their own threads, strategy and files
+    //  (named after the default ones, followed by .<name>)
+    static Governor* CreateDomain(const char* name);
+    // aborts if threads are subscribed to the domain, or expected to
+    // only the calling thread stops using it, so other threads that
+    //  prepared or reset it must not call Current() until they use another
+    //  governor
+    static void DestroyDomain(Governor* domain);
+    // governor of the domain the calling thread last prepared, subscribed
+    //  to or reset, or the default one
+    // if `required` is false, returns null instead of aborting if there's
+    //  no default governor, see Default()
+    static Governor* Current(bool required = true)
+    {
+        if (Governor* governor = _current)
+            return governor;
+
+        return required ? Default() :
+            _default.load(std::memory_order_acquire);
     }
 
 private:
-    Governor();
+    Governor(const char* domain = nullptr);
     ~Governor();
 
+    // path of a file (or other resource) of this domain
+    std::string DomainPath(std::string const& path) const;
+
+    // set up the schedule file, rng and strategy, called at first use
+    void Init();
+
+    // check if the run or time budget is exhausted, reports if so
+    bool BudgetExhausted() const;
+    bool BudgetReached() const;
+    // close the sequence just run, and account for it
+    void EndSequence();
+    // hash the sequence just run, and archive it if it is a new trace
+    void RecordTrace();
+    // write statistics to the GOV_REPORT file
+    void WriteReport() const;
+    // save the sequence just run and campaign totals to the checkpoint
+    //  file, replacing the previous checkpoint atomically
+    void WriteCheckpoint() const;
+    // read the checkpoint's sequence, and the totals of earlier processes
+    // returns false if there is no valid checkpoint
+    bool ReadCheckpoint(std::vector<SchedPoint>& sched);
+    // get strategy used, aborts if GOV_MODE does not name one
+    Strategy* GetStrategy() const;
     ThreadState* GetThreadState() const;
+    // get id of control point site, which is stable across runs
+    size_t GetSiteId(const char* file, int line);
+    // check if site passes the site filters
+    bool SiteAllowed(const char* file, int line, const char* func);
+    static bool SiteMatches(std::vector<std::string> const& patterns,
+        const char* file, int line, const char* func);
+
+    // set up the governor if needed, and fork workers, before threads
+    //  are expected to subscribe
+    void Start();
+    // fork worker processes and wait for them, returns only in workers
+    void Supervise();
 
     // update affinity for calling thread
     void SetAffinity(bool apply);
     // determine a new running thread
     // returns true if a new thread was chosen
     bool UpdateActiveThread();
-    std::thread::id ChooseThread(RunMode mode);
+    std::thread::id ChooseThread();
 
     // file fns
     // opens or refreshes file handles
     // if close = true, closes all handles
     void HandleOutFile(bool close);
+    // opens and maps _fileName
+    void OpenFile();
+    // clears the last sequence from the file, past _fileIdx
+    void ClearFileEnd();
     // maps file to memory, sets it to specified size
     // this updates _fileSize
     void MapFileToMem(size_t size);
 
 private:
+    // governor of the domain the calling thread last used, null for the
+    //  default one
+    // __thread, unlike thread_local, is accessed without a wrapper call
+    static __thread Governor* _current;
+    // site of the last control point the calling thread reached, 0 if none
+    // read by HandleCrash(), which runs on the crashing thread
+    static __thread size_t _threadSite;
+    // default governor, once constructed
+    static std::atomic<Governor*> _default;
+
     // mutex that must be held when modifying shared data
     std::mutex _mutex;
-    // scheduling mode used
-    RunMode _runMode = RUN_PRESET;
+    // name of domain, empty for the default governor
+    std::string const _domain;
+    // setup is deferred until the governor is used, see Init()
+    std::once_flag _initFlag;
+    bool _initialized = false;
+    // coordinator shared with other processes, null unless GOV_COORD is set
+    std::unique_ptr<Coordinator> _coord;
+    // name of scheduling mode used, and strategy that implements it
+    // strategy is null until a strategy named after the mode is registered
+    std::string _modeName;
+    Strategy* _strategy = nullptr;
+    // strategies that can be used, owned by the governor
+    std::map<std::string, std::unique_ptr<Strategy>> _strategies;
     // file that stores sequence for scheduling
     // depending on run mode, this file is either read or written to
+    std::string _fileName;
     int _fileDesc = -1;
     char* _filePtr = nullptr;
     size_t _fileSize = 0u;
     size_t _fileIdx = 0u;
-    // sequence used for scheduling, if not-empty
+    // end of the last sequence, which is left in file past _fileIdx until
+    //  the sequence being written differs from it
+    size_t _fileEnd = 0u;
+    // offset past each step of the sequence in file, and steps of it the
+    //  next sequence repeats, which are left as they are
+    std::vector<size_t> _fileSteps;
+    size_t _fileShared = 0u;
+    // sequence scheduled so far, or last sequence read from file
     std::vector<SchedPoint> _sched;
-    size_t _schedIdx = 0;
     bool _schedDone = false;
+    bool _schedFailed = false; // last sequence read crashed the program
+    bool _stopOnFail = false; // stop instead of running past a failure
+    bool _catchSignals = true; // save failing sequences on fatal signals
+    bool _inReset = false;
+    size_t _lastSite = 0; // site of last thread chosen to run
+
+    // worker processes, see Strategy::NumWorkers()
+    bool _supervised = false; // workers were forked, if needed
+    size_t _worker = SIZE_MAX; // index of this worker process, if one
+    // totals of all workers, null if there are none
+    WorkerTotals* _totals = nullptr;
+
+    // budgets for running sequences in this process, 0 if unlimited
+    size_t _budgetRuns = 0;
+    size_t _budgetSecs = 0;
+    size_t _numRuns = 0; // sequences run in this process
+    std::chrono::steady_clock::time_point _startTime;
+    bool _stopped = false; // true once a budget is exhausted
 
     size_t _threadsToSub = 0u;
+    // threads are being launched, see Launch()
+    bool _launching = false;
+    // _threadsToSub counts launched threads, rather than Prepare()'s
+    bool _launchedToSub = false;
+    size_t _numLaunched = 0u;
     // maintains state of threads and whether they're on a control point
     std::unordered_map<std::thread::id, ThreadState*> _threads;
     std::map<size_t /*threadId*/, std::thread::id> _threadIds;
+    // threads that can be run at the current scheduling point, and the
+    //  control point site each of them is waiting at
+    std::vector<size_t> _runnable;
+    std::vector<size_t> _runnableSites;
+    // symmetry classes with an unstarted thread already deemed runnable
+    std::vector<size_t> _unstartedClasses;
+    // spin detection, for bounded fairness
+    // counts visits to each site by the last thread run, since it started
+    //  running uninterrupted
+    size_t _spinLimit = 0;
+    size_t _streakThreadId = SIZE_MAX;
+    std::unordered_map<size_t /*site*/, size_t> _streakVisits;
+    size_t _numSpinPrunes = 0;
+    bool _livelockReported = false;
     // currently executing thread
     std::atomic<std::thread::id> _activeThreadId;
 
     // cpu affinity masks
     cpu_set_t* _defaultCpuSet = nullptr; // default affinity mask
     cpu_set_t* _cpuSet = nullptr; // mask with only one random CPU
-    // random generator, used in RUN_RANDOM
+    // random generator, used to seed strategies
     std::minstd_rand _rng;
+
+    // checkpoint of the last sequence run, in _fileName.ckpt, written
+    //  every _checkpointSecs seconds if not 0
+    // it is resumed if the schedule file isn't complete at startup
+    size_t _checkpointSecs = 0;
+    std::chrono::steady_clock::time_point _lastCheckpoint;
+    // totals of processes that ran before, read from the checkpoint
+    size_t _prevRuns = 0;
+    size_t _prevFailures = 0;
+    double _prevSecs = 0.0;
+
+    // statistics of sequences run in this process, for GOV_REPORT
+    // written at exit, and every _reportEvery sequences if not 0
+    std::string _reportPath;
+    size_t _reportEvery = 0;
+    size_t _numSteps = 0; // steps scheduled
+    size_t _sumDepth = 0; // steps of complete sequences
+    size_t _maxDepth = 0;
+    size_t _numFailures = 0; // failed sequences found in schedule file
+    // sum of threads available to run, and times it was summed, per step
+    std::vector<size_t> _branchSum;
+    std::vector<size_t> _branchCount;
+
+    // hashes of equivalent traces seen, null unless GOV_TRACES is set
+    std::unique_ptr<TraceSet> _traces;
+    // dir where sequences of new traces are saved, empty if none
+    std::string _archiveDir;
+
+    // file name -> hash, used to compute site ids
+    std::unordered_map<const char*, size_t> _fileHashes;
+    // site filters, set at construction and only read afterwards
+    std::vector<std::string> _sitesInclude;
+    std::vector<std::string> _sitesExclude;
 };
 
-#define sGovernor Governor::instance()
+#define sGovernor Governor::Default()
 
 #endif // __GOVERNOR_IMPL_H__
 
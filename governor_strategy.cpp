@@ -0,0 +1,747 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "governor_strategy.h"
+#include "governor_impl.h"
+#include "governor_coord.h"
+
+size_t SchedPoint::read(char* buffer)
+{
+    int nchars = 0; // number of chars read
+    int ret = std::sscanf(buffer, "%lu %lu %lu\n%n",
+        &threadId, &available, &higher, &nchars);
+
+    if (ret <= 0 || nchars <= 0)
+        return 0u;
+
+    return nchars;
+}
+
+size_t SchedPoint::write(char* buffer, size_t size)
+{
+    int ret = std::snprintf(buffer, size, "%lu %lu %lu\n",
+        threadId, available, higher);
+
+    if (ret <= 0)
+        return 0u;
+
+    return ret;
+}
+
+bool WriteSchedule(std::string const& path, std::vector<SchedPoint> const& sched)
+{
+    FILE* f = std::fopen(path.c_str(), "w");
+    if (f == nullptr)
+        return false;
+
+    char line[128];
+    for (SchedPoint sp : sched)
+    {
+        if (sp.write(line, sizeof(line)))
+            std::fputs(line, f);
+    }
+
+    std::fputs("END\n", f);
+    return std::fclose(f) == 0;
+}
+
+bool WriteFileAtomic(std::string const& path,
+    std::function<void(FILE*)> const& write, bool sync /*= false*/)
+{
+    std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "w");
+    if (f == nullptr)
+        return false;
+
+    write(f);
+
+    bool ok = (std::fflush(f) == 0 && !std::ferror(f));
+    if (ok && sync)
+        ok = (fsync(fileno(f)) == 0);
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    if (!sync)
+        return true;
+
+    // make the rename itself durable
+    size_t slash = path.rfind('/');
+    std::string dir = (slash == std::string::npos) ? "." :
+        path.substr(0, slash + 1);
+    int dirDesc = open(dir.c_str(), O_RDONLY);
+    if (dirDesc != -1)
+    {
+        fsync(dirDesc);
+        close(dirDesc);
+    }
+
+    return true;
+}
+
+bool RandomStrategy::Reset(std::vector<SchedPoint>& /*last*/,
+    bool /*done*/)
+{
+    return true;
+}
+
+size_t RandomStrategy::Choose(StepContext const& ctx)
+{
+    // choose a random thread of the available ones
+    std::uniform_int_distribution<size_t> dist(0, ctx.threadIds.size() - 1);
+    return ctx.threadIds[dist(_rng)];
+}
+
+ExploreStrategy::~ExploreStrategy()
+{
+    // sequence being run was completed, so that whoever resumes this
+    //  worker's work moves past it
+    if (_coord && _running)
+    {
+        WorkItem item;
+        item.floor = _floor;
+        item.done = true;
+        item.prefix = _sched;
+        _coord->Save(item);
+    }
+}
+
+bool ExploreStrategy::Reset(std::vector<SchedPoint>& last, bool done)
+{
+    if (done)
+        UpdateProgress(last);
+
+    _running = false;
+    if (_coord)
+        return ResetShared(last, done);
+
+    // prepare next scheduling sequence
+    // next scheduling sequence uses same prefix, and uses
+    //  a different (higher) threadId at last possible option
+    _sched.swap(last);
+    _sharedSteps = _sched.size();
+
+    // if last execution wasn't complete, just repeat it
+    if (!done)
+    {
+        _progress.resize(std::min(_progress.size(), _sharedSteps));
+        return true;
+    }
+
+    if (!Advance(0))
+    {
+        GOV_ERR("RUN_EXPLORE - reached last state");
+        return false;
+    }
+
+    _progress.resize(std::min(_progress.size(), _sharedSteps));
+    return true;
+}
+
+bool ExploreStrategy::Advance(size_t floor)
+{
+    while (_sched.size() > floor)
+    {
+        SchedPoint& sp = _sched.back();
+        if (sp.higher == 0)
+        {
+            _sched.pop_back();
+            continue;
+        }
+
+        // use the next threadId
+        // if it does not exist (i.e there's a gap), it will be corrected
+        //  at schedule time
+        sp.threadId += 1;
+        sp.higher -= 1;
+        _sharedSteps = std::min(_sharedSteps, _sched.size() - 1);
+        return true;
+    }
+
+    _sharedSteps = std::min(_sharedSteps, _sched.size());
+    return false;
+}
+
+bool LocalStrategy::Reset(std::vector<SchedPoint>& last, bool done)
+{
+    if (!_started)
+    {
+        if (FILE* f = std::fopen(_path.c_str(), "r"))
+        {
+            SchedPoint sp;
+            char line[128];
+            while (std::fgets(line, sizeof(line), f) && sp.read(line))
+                _around.push_back(sp);
+
+            std::fclose(f);
+            _started = true;
+        }
+    }
+
+    // start with the first sequence that shares the prefix, saving the one
+    //  explored around, as the schedule file will be overwritten
+    if (!_started)
+    {
+        if (last.empty())
+        {
+            GOV_ERR("RUN_LOCAL - no schedule to explore around");
+            error_abort();
+        }
+
+        if (!WriteSchedule(_path, last))
+        {
+            GOV_ERR("RUN_LOCAL - failed to write %s", _path.c_str());
+            error_abort();
+        }
+
+        _started = true;
+        _around = last;
+        _sched.assign(last.begin(),
+            last.begin() + std::min(_prefix, last.size()));
+        _sharedSteps = _sched.size();
+        return true;
+    }
+
+    _sched.swap(last);
+    _sharedSteps = _sched.size();
+
+    // if last execution wasn't complete, just repeat it
+    if (!done)
+        return true;
+
+    _numRuns += !_sched.empty();
+
+    // steps past the window aren't explored, see Choose()
+    if (_window && _sched.size() > _prefix + _window)
+    {
+        _sched.resize(_prefix + _window);
+        _sharedSteps = _sched.size();
+    }
+
+    if (!Advance(_prefix))
+    {
+        GOV_ERR("RUN_LOCAL - reached last state");
+        Report(stderr);
+        return false;
+    }
+
+    return true;
+}
+
+size_t LocalStrategy::Choose(StepContext const& ctx)
+{
+    // steps past the window follow the sequence explored around, if its
+    //  thread is available, so that later steps stay close to it
+    size_t idx = ctx.step;
+    if (_window && idx >= _prefix + _window && idx == _sched.size() &&
+        idx < _around.size())
+    {
+        auto itr = std::lower_bound(ctx.threadIds.begin(),
+            ctx.threadIds.end(), _around[idx].threadId);
+        if (itr == ctx.threadIds.end() || *itr != _around[idx].threadId)
+            itr = ctx.threadIds.begin();
+
+        SchedPoint sp;
+        sp.threadId = *itr;
+        sp.available = ctx.threadIds.size();
+        sp.higher = ctx.threadIds.end() - itr - 1;
+        _sched.push_back(sp);
+    }
+
+    return ExploreStrategy::Choose(ctx);
+}
+
+void LocalStrategy::Report(FILE* out) const
+{
+    fprintf(out, "RUN_LOCAL - %lu schedules run around %s, from step %lu\n",
+        _numRuns, _path.c_str(), _prefix);
+}
+
+bool ExploreStrategy::ResetShared(std::vector<SchedPoint>& last,
+    bool done)
+{
+    // each worker explores a subtree, saved in the coordinator, so that
+    //  another process can resume it
+    WorkItem item;
+    bool active = _coord->Load(item);
+    if (active)
+    {
+        _floor = item.floor;
+        _sched.swap(last);
+        _sharedSteps = _sched.size();
+
+        // nothing was run since the item was saved
+        if (_sched.empty())
+        {
+            _sched = item.prefix;
+            _sharedSteps = 0;
+            done = item.done;
+        }
+    }
+
+    while (true)
+    {
+        // take a new subtree once this one is done
+        if (!active)
+        {
+            if (!_coord->Take(item))
+            {
+                GOV_ERR("RUN_EXPLORE - reached last state");
+                return false;
+            }
+
+            _floor = item.floor;
+            _sched = item.prefix;
+            _sharedSteps = 0;
+            done = item.done;
+            active = true;
+        }
+
+        if (!done || Advance(_floor))
+            break;
+
+        active = false;
+    }
+
+    // share the unexplored siblings of the shallowest step that has any
+    //  with waiting workers, and keep the rest of the subtree
+    // the last step was just advanced, so it is only known once it's run
+    if (_coord->WantsWork())
+    {
+        for (size_t i = _floor; i + 1 < _sched.size(); ++i)
+        {
+            if (_sched[i].higher == 0)
+                continue;
+
+            WorkItem shared;
+            shared.floor = i;
+            shared.done = true;
+            shared.prefix.assign(_sched.begin(), _sched.begin() + i + 1);
+            if (_coord->Give(shared))
+                _floor = i + 1;
+
+            break;
+        }
+    }
+
+    item.floor = _floor;
+    item.done = false;
+    item.prefix = _sched;
+    _coord->Save(item);
+    _progress.resize(std::min(_progress.size(), _sharedSteps));
+
+    return true;
+}
+
+size_t ExploreStrategy::Choose(StepContext const& ctx)
+{
+    size_t idx = ctx.step;
+    assert(idx <= _sched.size());
+    _running = true;
+
+    // if there's no info in schedule, use first available threadId
+    if (idx == _sched.size())
+    {
+        SchedPoint sp;
+        sp.threadId = ctx.threadIds.front();
+        sp.available = ctx.threadIds.size();
+        sp.higher = sp.available - 1;
+        _sched.push_back(sp);
+    }
+
+    size_t threadId = _sched[idx].threadId;
+
+    // last point in known schedule
+    // this point was generated by adding 1 to last threadId,
+    //  so the threadId might not exist, and we need to ensure
+    //  that it does
+    if (idx == _sched.size() - 1)
+    {
+        // use first threadId that is >= indicated threadId
+        auto itr = std::lower_bound(ctx.threadIds.begin(),
+            ctx.threadIds.end(), threadId);
+        if (itr != ctx.threadIds.end())
+        {
+            threadId = *itr;
+            _sched[idx].threadId = threadId;
+            _sched[idx].higher = ctx.threadIds.end() - itr - 1;
+        }
+    }
+
+    // so that the step isn't lost if the process dies
+    if (_coord)
+        _coord->Record(idx, _sched[idx]);
+
+    return threadId;
+}
+
+double ExploreStrategy::EstimatedTotal() const
+{
+    double covered = _fraction - _startFraction;
+    if (_numRuns == 0 || covered <= 0.0)
+        return 0.0;
+
+    return _numRuns / covered;
+}
+
+double ExploreStrategy::EstimatedSecsLeft() const
+{
+    double covered = _fraction - _startFraction;
+    if (_numRuns == 0 || covered <= 0.0)
+        return -1.0;
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - _startTime;
+    return elapsed.count() * (1.0 - _fraction) / covered;
+}
+
+void ExploreStrategy::Report(FILE* out) const
+{
+    fprintf(out, "RUN_EXPLORE - %.2f%% of schedule tree done, ~%.3g "
+        "schedules total\n", _fraction * 100.0, EstimatedTotal());
+}
+
+void ExploreStrategy::UpdateProgress(std::vector<SchedPoint> const& last)
+{
+    // weight of all leaves to the left of this one, plus its own
+    // steps shared with the last sequence were already summed
+    size_t i = std::min(_progress.size(), last.size());
+    _progress.resize(i);
+    double fraction = i ? _progress[i - 1].first : 0.0;
+    // probability of reaching current node
+    double weight = i ? _progress[i - 1].second : 1.0;
+    for (; i < last.size(); ++i)
+    {
+        SchedPoint const& sp = last[i];
+        size_t idx = sp.available - sp.higher - 1; // index of choice
+        fraction += weight * idx / sp.available;
+        weight /= sp.available;
+        _progress.emplace_back(fraction, weight);
+    }
+
+    fraction += weight;
+
+    // first complete sequence seen is where this process started
+    // it may have been run by a previous process
+    auto now = std::chrono::steady_clock::now();
+    if (_startFraction < 0.0)
+    {
+        _startFraction = fraction;
+        _fraction = fraction;
+        _startTime = now;
+        _lastReport = now;
+        return;
+    }
+
+    _numRuns++;
+    _fraction = fraction;
+
+    if (_progressSecs == 0 ||
+        now - _lastReport < std::chrono::seconds(_progressSecs))
+        return;
+
+    _lastReport = now;
+    fprintf(stderr, "RUN_EXPLORE - %lu schedules run, ~%.3g total, "
+        "%.2f%% done, ETA %.0fs\n", _numRuns, EstimatedTotal(),
+        _fraction * 100.0, EstimatedSecsLeft());
+}
+
+bool PresetStrategy::Reset(std::vector<SchedPoint>& last,
+    bool /*done*/)
+{
+    _sched.swap(last);
+    // return false if we've already used the available sequence
+    return _numResets++ == 0;
+}
+
+size_t PresetStrategy::Choose(StepContext const& ctx)
+{
+    size_t idx = ctx.step;
+    if (idx >= _sched.size())
+    {
+        GOV_ERR("RUN_PRESET - no scheduling available at idx %lu", idx);
+        error_abort();
+    }
+
+    SchedPoint const& sp = _sched[idx];
+
+    auto itr = std::lower_bound(ctx.threadIds.begin(), ctx.threadIds.end(),
+        sp.threadId);
+    if (itr == ctx.threadIds.end() || *itr != sp.threadId)
+    {
+        GOV_ERR("RUN_PRESET - threadId %lu is invalid at line %lu",
+            sp.threadId, idx + 1);
+        error_abort();
+    }
+
+    if (sp.available != ctx.threadIds.size())
+    {
+        GOV_ERR("RUN_PRESET - wrong available value (%lu vs %lu) at "
+            "line %lu", sp.available, ctx.threadIds.size(), idx + 1);
+        error_abort();
+    }
+
+    size_t higher = ctx.threadIds.end() - itr - 1;
+    if (sp.higher != higher)
+    {
+        GOV_ERR("RUN_PRESET - wrong higher value (%lu vs %lu) at "
+            "line %lu", sp.higher, higher, idx + 1);
+        error_abort();
+    }
+
+    return sp.threadId;
+}
+
+bool PctStrategy::Reset(std::vector<SchedPoint>& last, bool /*done*/)
+{
+    // last schedule length is our best estimate for k
+    _steps = std::max(_steps, last.size());
+
+    _priority.clear();
+    _changePoints.clear();
+
+    // without an estimate of the schedule length, run without change points
+    // the estimate is refined once this schedule completes
+    if (_steps == 0)
+        return true;
+
+    // pick d-1 change points uniformly in [0, k)
+    // they're kept in the order drawn, as the priority each one gives
+    //  doesn't depend on when it happens
+    std::uniform_int_distribution<size_t> dist(0, _steps - 1);
+    for (size_t i = 1; i < _depth; ++i)
+        _changePoints.push_back(dist(_rng));
+
+    return true;
+}
+
+size_t PctStrategy::Choose(StepContext const& ctx)
+{
+    // initial priorities are a random permutation of d..d+n-1, so that
+    //  they're distinct and higher than any priority given at a change
+    //  point
+    // threads are only known once first scheduled, so each new one is
+    //  inserted at a random rank among the threads not yet lowered
+    for (size_t threadId : ctx.threadIds)
+    {
+        if (_priority.find(threadId) != _priority.end())
+            continue;
+
+        std::vector<size_t> initial;
+        for (auto const& p : _priority)
+        {
+            if (p.second >= _depth)
+                initial.push_back(p.second);
+        }
+        std::sort(initial.begin(), initial.end());
+
+        std::uniform_int_distribution<size_t> rank(0, initial.size());
+        size_t r = rank(_rng);
+        size_t priority = (r < initial.size()) ? initial[r] :
+            (initial.empty() ? _depth : initial.back() + 1);
+        for (auto& p : _priority)
+        {
+            if (p.second >= priority)
+                p.second++;
+        }
+
+        _priority[threadId] = priority;
+    }
+
+    // run the available thread with highest priority
+    // ties are broken by lowest threadId
+    auto highest = [this, &ctx]() -> size_t {
+        size_t best = ctx.threadIds.front();
+        for (size_t threadId : ctx.threadIds)
+        {
+            if (_priority[threadId] > _priority[best])
+                best = threadId;
+        }
+
+        return best;
+    };
+
+    size_t threadId = highest();
+
+    // at the i-th change point drawn, the priority of the thread about to
+    //  run is lowered to d-i, and a new highest priority thread is chosen
+    for (size_t i = 0; i < _changePoints.size(); ++i)
+    {
+        if (_changePoints[i] != ctx.step)
+            continue;
+
+        _priority[threadId] = _depth - (i + 1);
+        threadId = highest();
+    }
+
+    return threadId;
+}
+
+DelayStrategy::DelayStrategy(std::string const& path, size_t bound) :
+    _path(path), _bound(bound)
+{
+    // one "step delays" line per step with delays
+    if (FILE* f = std::fopen(_path.c_str(), "r"))
+    {
+        size_t step, delays;
+        while (std::fscanf(f, "%lu %lu", &step, &delays) == 2)
+            _plan[step] = delays;
+
+        std::fclose(f);
+        _started = true;
+    }
+}
+
+bool DelayStrategy::Reset(std::vector<SchedPoint>& last, bool done)
+{
+    _lastThreadId = SIZE_MAX;
+
+    // first sequence uses the default scheduler
+    if (!_started)
+    {
+        _started = true;
+        _plan.clear();
+        _planChanged = true;
+        return true;
+    }
+
+    // if last execution wasn't complete, just repeat it
+    if (!done)
+        return true;
+
+    // delays used at each step of the last sequence
+    std::vector<size_t> delays(last.size(), 0);
+    size_t used = 0;
+    for (auto const& p : _plan)
+    {
+        if (p.first < last.size())
+        {
+            delays[p.first] = p.second;
+            used += p.second;
+        }
+    }
+
+    // add a delay at the last step that allows it, and drop the ones after
+    // a step allows skipping all but one of the available threads
+    for (size_t j = last.size(); j-- > 0;)
+    {
+        used -= delays[j];
+        if (delays[j] + 1 >= last[j].available || used + delays[j] + 1 > _bound)
+            continue;
+
+        _plan.clear();
+        for (size_t i = 0; i < j; ++i)
+        {
+            if (delays[i])
+                _plan[i] = delays[i];
+        }
+        _plan[j] = delays[j] + 1;
+
+        _planChanged = true;
+        return true;
+    }
+
+    GOV_ERR("RUN_DELAY - reached last state");
+    return false;
+}
+
+size_t DelayStrategy::Choose(StepContext const& ctx)
+{
+    std::vector<size_t> const& threadIds = ctx.threadIds;
+
+    // the plan is saved once its sequence starts, as the next process
+    //  derives its plan from the one the last sequence in file ran with
+    // one prepared when a budget stops the campaign is never run
+    if (_planChanged)
+    {
+        SavePlan();
+        _planChanged = false;
+    }
+
+    // round-robin, from the last thread run
+    size_t idx = 0;
+    if (_lastThreadId != SIZE_MAX)
+    {
+        idx = std::lower_bound(threadIds.begin(), threadIds.end(),
+            _lastThreadId) - threadIds.begin();
+        if (idx == threadIds.size())
+            idx = 0;
+    }
+
+    // each delay skips a thread
+    auto itr = _plan.find(ctx.step);
+    if (itr != _plan.end())
+        idx = (idx + itr->second) % threadIds.size();
+
+    _lastThreadId = threadIds[idx];
+    return _lastThreadId;
+}
+
+void DelayStrategy::SavePlan() const
+{
+    bool ok = WriteFileAtomic(_path, [this](FILE* f) {
+        for (auto const& p : _plan)
+            std::fprintf(f, "%lu %lu\n", p.first, p.second);
+    });
+
+    if (!ok)
+    {
+        GOV_ERR("failed to write %s", _path.c_str());
+        error_abort();
+    }
+}
+
+bool CStrategy::ReadsSchedule() const
+{
+    return _strategy.reads_schedule != 0;
+}
+
+bool CStrategy::Reset(std::vector<SchedPoint>& last, bool done)
+{
+    if (_strategy.reset == nullptr)
+        return true;
+
+    std::vector<size_t> threadIds;
+    for (SchedPoint const& sp : last)
+        threadIds.push_back(sp.threadId);
+
+    return _strategy.reset(_strategy.data, threadIds.data(),
+        threadIds.size(), done) != 0;
+}
+
+size_t CStrategy::Choose(StepContext const& ctx)
+{
+    gov_step step;
+    step.step = ctx.step;
+    step.num_threads = ctx.threadIds.size();
+    step.thread_ids = ctx.threadIds.data();
+    step.sites = ctx.sites.data();
+
+    return _strategy.choose(_strategy.data, &step);
+}
@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GOVERNOR_STRATEGY_H__
+#define __GOVERNOR_STRATEGY_H__
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+
+#include <sys/types.h>
+
+#include <vector>
+#include <map>
+#include <utility>
+#include <string>
+#include <random>
+#include <chrono>
+#include <functional>
+
+#include "governor.h"
+
+class Coordinator;
+
+// contains info stored at each scheduling point
+struct SchedPoint
+{
+public:
+    size_t threadId; // thread id to be run
+    size_t available; // number of threads that were available to be run
+    size_t higher; // number of threads with threadId higher than `threadId`
+
+public:
+    // read/write using a char buffer
+    // buffer can be assumed to have at least one ending \0
+    size_t read(char* buffer);
+    // size describes buffer size
+    size_t write(char* buffer, size_t size);
+};
+
+// write a complete sequence to a schedule file at `path`, ending with END
+// returns false if the file can't be written
+bool WriteSchedule(std::string const& path, std::vector<SchedPoint> const& sched);
+
+// write a file at `path` with `write`, so that readers (and a crashed
+//  process) see either the previous file or the complete new one
+// it's written to `path`.tmp, then renamed over `path`
+// if `sync`, the file and the rename are made durable as well, so they also
+//  survive the machine going down
+// returns false if the file can't be written, leaving `path` as it was
+bool WriteFileAtomic(std::string const& path,
+    std::function<void(FILE*)> const& write, bool sync = false);
+
+// info given to a strategy at each scheduling point
+struct StepContext
+{
+    size_t step; // index of scheduling point in the current sequence
+    // threadIds that can be run, in increasing order
+    std::vector<size_t> const& threadIds;
+    // id of the control point site each thread is waiting at
+    std::vector<size_t> const& sites;
+};
+
+// a scheduling strategy decides which thread runs at each scheduling point
+// the governor records the chosen sequence, and writes it to file if the
+//  strategy asks for it
+class Strategy
+{
+public:
+    virtual ~Strategy() { }
+
+    // if true, the last sequence is read from file before each Reset()
+    virtual bool ReadsSchedule() const { return false; }
+    // if true, the sequence is written to file as it is scheduled
+    virtual bool WritesSchedule() const { return true; }
+
+    // prepare the next schedule sequence
+    // `last` is the last sequence, read from file if ReadsSchedule(), or
+    //  the last one run in this process otherwise (empty if there's none)
+    // `done` is true if `last` reached the end of the program
+    // `last` is discarded afterwards, so its contents can be taken (e.g. by
+    //  swapping it), instead of copied
+    // returns false if there are no more schedule sequences to run, which
+    //  stops a process that ran none, see Governor::Reset()
+    virtual bool Reset(std::vector<SchedPoint>& last, bool done) = 0;
+    // first steps of the sequence passed to the last Reset() that the next
+    //  one is known to repeat, 0 if unknown
+    // they're not checked nor written again in the schedule file
+    virtual size_t SharedSteps() const { return 0; }
+    // choose the thread to run, must return one of ctx.threadIds
+    virtual size_t Choose(StepContext const& ctx) = 0;
+    // called with the sequence run, once it ends, including the last one
+    //  run by the process, which has no Reset() after it
+    virtual void End(std::vector<SchedPoint> const& /*sched*/) { }
+    // report coverage achieved so far
+    virtual void Report(FILE* /*out*/) const { }
+
+    // worker processes
+    // if NumWorkers() > 0, the first Prepare() forks that many workers,
+    //  which run the program, and replaces them while HasWork()
+    // the original process waits for them, then exits with Finish()
+    virtual size_t NumWorkers() const { return 0; }
+    virtual bool HasWork() const { return false; }
+    // called in a new worker process
+    virtual void StartWorker(size_t /*worker*/) { }
+    // called when a worker exits, with its waitpid() status
+    virtual void WorkerExited(size_t /*worker*/, pid_t /*pid*/,
+        int /*status*/) { }
+    // called once all workers exited, returns the process exit status
+    virtual int Finish(FILE* /*out*/) { return 0; }
+};
+
+// choose a random thread at each scheduling point
+class RandomStrategy : public Strategy
+{
+public:
+    RandomStrategy(uint32_t seed) : _rng(seed) { }
+
+    bool Reset(std::vector<SchedPoint>& last, bool done) override;
+    size_t Choose(StepContext const& ctx) override;
+
+    void Seed(uint32_t seed) { _rng.seed(seed); }
+
+private:
+    std::minstd_rand _rng;
+};
+
+// explore all sequences in order, each one derived from the last
+// this is equivalent to a DFS search
+class ExploreStrategy : public Strategy
+{
+public:
+    // progress is reported to stderr every `progressSecs`, 0 to disable
+    // if `coord` is given, the schedule tree is split with other workers
+    ExploreStrategy(size_t progressSecs = 0, Coordinator* coord = nullptr) :
+        _coord(coord), _progressSecs(progressSecs) { }
+    ~ExploreStrategy();
+
+    bool ReadsSchedule() const override { return true; }
+
+    bool Reset(std::vector<SchedPoint>& last, bool done) override;
+    size_t SharedSteps() const override { return _sharedSteps; }
+    size_t Choose(StepContext const& ctx) override;
+    void Report(FILE* out) const override;
+
+    // fraction of the schedule tree explored, as of the last sequence
+    double FractionDone() const { return _fraction; }
+    // estimated number of sequences in the tree, 0 if unknown
+    double EstimatedTotal() const;
+    // estimated seconds left to explore the tree, negative if unknown
+    double EstimatedSecsLeft() const;
+
+protected:
+    // move to the next sequence, without changing the first `floor` steps
+    // returns false if there's none
+    bool Advance(size_t floor);
+
+private:
+    // Reset() when sharing the tree with other workers
+    bool ResetShared(std::vector<SchedPoint>& last, bool done);
+    // update estimates with a complete sequence
+    void UpdateProgress(std::vector<SchedPoint> const& last);
+
+protected:
+    // sequence being followed, extended as the program runs
+    std::vector<SchedPoint> _sched;
+    // steps of the last sequence that _sched still follows, see SharedSteps()
+    size_t _sharedSteps = 0;
+
+private:
+    // work sharing, steps before _floor belong to other workers
+    Coordinator* _coord;
+    size_t _floor = 0;
+    bool _running = false; // sequence started since last Reset()
+
+    // progress estimation
+    // each sequence is a leaf of the schedule tree, and its weight is the
+    //  probability of reaching it by choosing uniformly at each step (as in
+    //  Knuth's random probing), i.e. 1/product of `available` on its path
+    // fraction done is the weight of all leaves up to the last sequence,
+    //  and the tree size is estimated as sequences run / weight covered
+    size_t _progressSecs;
+    size_t _numRuns = 0; // complete sequences run in this process
+    double _fraction = 0.0; // fraction done after last sequence
+    double _startFraction = -1.0; // fraction done when process started
+    // (fraction of leaves to the left, weight) after each step of _sched,
+    //  kept for the steps it still follows, so that only new ones are summed
+    std::vector<std::pair<double, double>> _progress;
+    std::chrono::steady_clock::time_point _startTime;
+    std::chrono::steady_clock::time_point _lastReport;
+};
+
+// explore the sequences around one, e.g. a failing one
+// all sequences that share its first `prefix` steps are explored, in the
+//  same order as ExploreStrategy, and if `window` isn't 0 only the `window`
+//  steps after the prefix vary, while later ones follow the sequence
+//  explored around, or run the first thread if its thread isn't available
+// the sequence explored around is read from the schedule file at first,
+//  and kept in a file at `path` to know that it was started
+class LocalStrategy : public ExploreStrategy
+{
+public:
+    LocalStrategy(std::string const& path, size_t prefix, size_t window) :
+        _path(path), _prefix(prefix), _window(window) { }
+
+    bool Reset(std::vector<SchedPoint>& last, bool done) override;
+    size_t Choose(StepContext const& ctx) override;
+    void Report(FILE* out) const override;
+
+private:
+    std::string _path;
+    size_t _prefix;
+    size_t _window;
+    bool _started = false; // whether the sequence explored around was saved
+    std::vector<SchedPoint> _around; // sequence explored around
+    size_t _numRuns = 0; // complete sequences run in this process
+};
+
+// run the sequence saved in file (once)
+class PresetStrategy : public Strategy
+{
+public:
+    bool ReadsSchedule() const override { return true; }
+    bool WritesSchedule() const override { return false; }
+
+    bool Reset(std::vector<SchedPoint>& last, bool done) override;
+    size_t Choose(StepContext const& ctx) override;
+
+private:
+    std::vector<SchedPoint> _sched;
+    size_t _numResets = 0;
+};
+
+// probabilistic concurrency testing
+// threads get random priorities, and the highest priority thread runs
+// at d-1 random steps, the running thread's priority is lowered
+class PctStrategy : public Strategy
+{
+public:
+    // depth is the bug depth d, steps an initial estimate of the schedule
+    //  length k (0 if unknown), which is refined with each sequence
+    PctStrategy(uint32_t seed, size_t depth, size_t steps) :
+        _rng(seed), _depth(depth), _steps(steps) { }
+
+    // last sequence is only read to estimate the schedule length
+    bool ReadsSchedule() const override { return true; }
+
+    bool Reset(std::vector<SchedPoint>& last, bool done) override;
+    size_t Choose(StepContext const& ctx) override;
+
+private:
+    std::minstd_rand _rng;
+    size_t _depth;
+    size_t _steps;
+    // threadId -> priority, assigned on first scheduling of threadId
+    std::map<size_t /*threadId*/, size_t> _priority;
+    // steps where the running thread gets its priority lowered, in the
+    //  order they were drawn
+    std::vector<size_t> _changePoints;
+};
+
+// delay-bounded scheduling
+// the default scheduler is round-robin: it keeps running the last thread
+//  run, and once it can't, runs the next thread in threadId order
+// a delay skips the thread the scheduler would run, and all sequences with
+//  at most `bound` delays are explored, in DFS order
+// the delays planned for the current sequence are saved in a file, and the
+//  ones actually used are derived from it and the last sequence
+class DelayStrategy : public Strategy
+{
+public:
+    DelayStrategy(std::string const& path, size_t bound);
+
+    // last sequence is read to know how many delays each step allowed
+    bool ReadsSchedule() const override { return true; }
+
+    bool Reset(std::vector<SchedPoint>& last, bool done) override;
+    size_t Choose(StepContext const& ctx) override;
+
+private:
+    // save planned delays to file
+    void SavePlan() const;
+
+private:
+    std::string _path;
+    size_t _bound;
+    bool _started = false; // whether there is a plan, saved or not
+    // step -> delays at that step, for steps with any delay
+    std::map<size_t, size_t> _plan;
+    bool _planChanged = false; // _plan is to be saved, see Choose()
+    size_t _lastThreadId = SIZE_MAX; // last thread run, if any
+};
+
+// adapts a strategy registered through the C API
+class CStrategy : public Strategy
+{
+public:
+    CStrategy(gov_strategy const& strategy) : _strategy(strategy) { }
+
+    bool ReadsSchedule() const override;
+
+    bool Reset(std::vector<SchedPoint>& last, bool done) override;
+    size_t Choose(StepContext const& ctx) override;
+
+private:
+    gov_strategy _strategy;
+};
+
+#endif // __GOVERNOR_STRATEGY_H__
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cinttypes>
+
+#include <algorithm>
+
+#include "governor_trace.h"
+#include "governor_impl.h"
+
+TraceSet::TraceSet(std::string const& path) : _path(path)
+{
+    // one hash per line, in hex
+    if (FILE* f = std::fopen(_path.c_str(), "r"))
+    {
+        uint64_t hash;
+        while (std::fscanf(f, "%" SCNx64, &hash) == 1)
+            _seen.insert(hash);
+
+        std::fclose(f);
+    }
+
+    _file = std::fopen(_path.c_str(), "a");
+    if (_file == nullptr)
+    {
+        GOV_ERR("failed to open %s", _path.c_str());
+        error_abort();
+    }
+}
+
+TraceSet::~TraceSet()
+{
+    if (_file)
+        std::fclose(_file);
+}
+
+void TraceSet::Begin()
+{
+    _events.clear();
+    _maxLevel = 0;
+    _maxUnknownLevel = 0;
+    _threadLevel.clear();
+    _accessLevel.clear();
+    _writeLevel.clear();
+}
+
+void TraceSet::Step(size_t threadId, size_t site, const void* addr,
+    AccessKind access)
+{
+    size_t level = 0;
+    if (access == ACCESS_UNKNOWN)
+    {
+        level = _maxLevel + 1;
+        _maxUnknownLevel = level;
+    }
+    else
+    {
+        // depends on last step of the same thread, on unannotated steps,
+        //  and on conflicting accesses to the same address
+        level = std::max(_threadLevel[threadId], _maxUnknownLevel);
+        if (access == ACCESS_WRITE)
+            level = std::max(level, _accessLevel[addr]);
+        else
+            level = std::max(level, _writeLevel[addr]);
+
+        level += 1;
+
+        size_t& accessLevel = _accessLevel[addr];
+        accessLevel = std::max(accessLevel, level);
+        if (access == ACCESS_WRITE)
+        {
+            size_t& writeLevel = _writeLevel[addr];
+            writeLevel = std::max(writeLevel, level);
+        }
+    }
+
+    _threadLevel[threadId] = level;
+    _maxLevel = std::max(_maxLevel, level);
+    _events.push_back(Event{level, threadId, site});
+}
+
+uint64_t TraceSet::End(bool& unique)
+{
+    // a thread's steps are all in different levels, so this is a total
+    //  order, and it's the same for all equivalent traces
+    std::sort(_events.begin(), _events.end(), [](Event const& a, Event const& b) {
+        if (a.level != b.level)
+            return a.level < b.level;
+        return a.threadId < b.threadId;
+    });
+
+    // FNV-1a over (level, threadId, site) of each step
+    uint64_t hash = 14695981039346656037ul;
+    auto mix = [&hash](uint64_t val) {
+        for (int i = 0; i < 8; ++i)
+        {
+            hash = (hash ^ (val & 0xFF)) * 1099511628211ul;
+            val >>= 8;
+        }
+    };
+
+    for (Event const& e : _events)
+    {
+        mix(e.level);
+        mix(e.threadId);
+        mix(e.site);
+    }
+
+    _numTraces++;
+    unique = _seen.insert(hash).second;
+    if (unique)
+    {
+        _numNew++;
+        std::fprintf(_file, "%016" PRIx64 "\n", hash);
+        std::fflush(_file);
+    }
+
+    return hash;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GOVERNOR_TRACE_H__
+#define __GOVERNOR_TRACE_H__
+
+#include <cstdint>
+#include <cstdio>
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// memory access performed after a control point, if annotated
+enum AccessKind
+{
+    ACCESS_UNKNOWN  = 0, // conflicts with every other access
+    ACCESS_READ     = 1,
+    ACCESS_WRITE    = 2,
+};
+
+// computes a canonical hash of executed traces, so that traces that only
+//  differ in the order of independent steps are deemed equal
+// steps are independent if run by different threads and accessing
+//  different addresses (or both reading); unannotated steps depend on all
+// canonical form is the Foata normal form: each step gets a level, one
+//  higher than any earlier step it depends on, and steps are sorted by
+//  (level, threadId)
+// hashes of traces seen so far are kept in a file, shared across runs
+class TraceSet
+{
+public:
+    // `path` holds the hashes of traces seen by previous runs
+    TraceSet(std::string const& path);
+    ~TraceSet();
+
+    // start a new trace
+    void Begin();
+    // add step to current trace
+    void Step(size_t threadId, size_t site, const void* addr,
+        AccessKind access);
+    // end current trace, returns its hash and whether it wasn't seen before
+    uint64_t End(bool& unique);
+
+    size_t NumTraces() const { return _numTraces; }
+    size_t NumUnique() const { return _seen.size(); }
+    size_t NumNew() const { return _numNew; }
+
+private:
+    struct Event
+    {
+        size_t level;
+        size_t threadId;
+        size_t site;
+    };
+
+    std::string _path;
+    FILE* _file = nullptr;
+    std::unordered_set<uint64_t> _seen;
+    size_t _numTraces = 0; // traces ended in this process
+    size_t _numNew = 0; // unique traces found in this process
+
+    // current trace
+    std::vector<Event> _events;
+    // max level of any step, and of unannotated steps
+    size_t _maxLevel = 0;
+    size_t _maxUnknownLevel = 0;
+    // max level of last step of each thread
+    std::unordered_map<size_t, size_t> _threadLevel;
+    // max level of any access, and of writes, to each address
+    std::unordered_map<const void*, size_t> _accessLevel;
+    std::unordered_map<const void*, size_t> _writeLevel;
+};
+
+#endif // __GOVERNOR_TRACE_H__
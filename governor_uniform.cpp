@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+
+#include "governor_uniform.h"
+
+UniformStrategy::UniformStrategy(uint32_t seed) : _rng(seed)
+{
+    _nodes.emplace_back();
+    _path.push_back(0);
+}
+
+bool UniformStrategy::Reset(std::vector<SchedPoint>& last, bool done)
+{
+    // node where the last sequence ended is a leaf
+    if (done && !last.empty() && !_path.empty())
+    {
+        Node& leaf = _nodes[_path.back()];
+        if (leaf.children.empty())
+        {
+            _numLeaves += (leaf.leaves == 0.0);
+            leaf.leaves = 1.0;
+        }
+
+        // then update estimates of the nodes above it
+        for (size_t i = _path.size() - 1; i-- > 0; )
+        {
+            Node& node = _nodes[_path[i]];
+            double leaves = 0.0;
+            for (uint32_t child : node.children)
+                leaves += child ? _nodes[child].leaves : 0.0;
+
+            node.leaves = leaves + UnseenLeaves(node);
+        }
+    }
+
+    _numRuns += done && !last.empty();
+    _path.assign(1, 0);
+    return true;
+}
+
+double UniformStrategy::UnseenLeaves(Node const& node) const
+{
+    double seen = 0.0;
+    size_t numSeen = 0;
+    for (uint32_t child : node.children)
+    {
+        if (child && _nodes[child].leaves > 0.0)
+        {
+            seen += _nodes[child].leaves;
+            numSeen++;
+        }
+    }
+
+    size_t numUnseen = node.children.size() - numSeen;
+    if (numSeen == 0)
+        return numUnseen;
+
+    return numUnseen * seen / numSeen;
+}
+
+size_t UniformStrategy::Choose(StepContext const& ctx)
+{
+    size_t available = ctx.threadIds.size();
+
+    // past the nodes kept, choose uniformly
+    if (_path.empty())
+    {
+        std::uniform_int_distribution<size_t> dist(0, available - 1);
+        return ctx.threadIds[dist(_rng)];
+    }
+
+    // a node reached with a different number of threads available means
+    //  the program isn't deterministic, so its estimates are dropped
+    Node* node = &_nodes[_path.back()];
+    if (node->children.size() != available)
+    {
+        node->children.assign(available, 0);
+        node->leaves = 0.0;
+    }
+
+    // choose each thread with probability proportional to the estimated
+    //  leaves under it
+    double unseen = UnseenLeaves(*node);
+    size_t numUnseen = 0;
+    for (uint32_t child : node->children)
+        numUnseen += !(child && _nodes[child].leaves > 0.0);
+
+    std::vector<double> weights(available);
+    for (size_t i = 0; i < available; ++i)
+    {
+        uint32_t child = node->children[i];
+        weights[i] = (child && _nodes[child].leaves > 0.0) ?
+            _nodes[child].leaves : unseen / numUnseen;
+    }
+
+    std::discrete_distribution<size_t> dist(weights.begin(), weights.end());
+    size_t idx = dist(_rng);
+
+    // move to the child, adding it if there's room
+    uint32_t child = node->children[idx];
+    if (child == 0 && _nodes.size() < UNIFORM_MAX_NODES)
+    {
+        child = _nodes.size();
+        node->children[idx] = child;
+        _nodes.emplace_back();
+    }
+
+    if (child)
+        _path.push_back(child);
+    else
+        _path.clear();
+
+    return ctx.threadIds[idx];
+}
+
+void UniformStrategy::Report(FILE* out) const
+{
+    fprintf(out, "RUN_UNIFORM - %lu distinct schedules in %lu runs, ~%.3g "
+        "schedules total\n", _numLeaves, _numRuns, EstimatedTotal());
+}
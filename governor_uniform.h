@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2019 Ricardo Leite
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GOVERNOR_UNIFORM_H__
+#define __GOVERNOR_UNIFORM_H__
+
+#include <cstdint>
+
+#include <vector>
+#include <random>
+
+#include "governor_strategy.h"
+
+// max nodes of the schedule tree kept by UniformStrategy
+// below them, choices are uniform at each step
+constexpr size_t UNIFORM_MAX_NODES = 1 << 22;
+
+// sample complete sequences approximately uniformly, used in RUN_UNIFORM
+// choosing uniformly at each step favors sequences in narrow subtrees, so
+//  instead each choice is weighted by the estimated number of sequences
+//  (leaves) under it
+// the part of the schedule tree seen by sequences run in this process is
+//  kept, and a subtree's leaves are estimated from the `available` counts
+//  observed in it, with unseen subtrees assumed to be as large as their
+//  seen siblings on average
+class UniformStrategy : public Strategy
+{
+public:
+    UniformStrategy(uint32_t seed);
+
+    bool Reset(std::vector<SchedPoint>& last, bool done) override;
+    size_t Choose(StepContext const& ctx) override;
+    void Report(FILE* out) const override;
+
+    // estimated number of sequences in the tree
+    double EstimatedTotal() const { return _nodes[0].leaves; }
+
+private:
+    // a scheduling point, or the end of a sequence if it has no children
+    struct Node
+    {
+        // estimated leaves under node, 0 if not estimated yet
+        double leaves = 0.0;
+        // node of each choice, by index in StepContext::threadIds
+        // 0 if the choice wasn't taken yet, as the root is never a child
+        std::vector<uint32_t> children;
+    };
+
+    // estimated leaves under the choices of a node that weren't taken
+    double UnseenLeaves(Node const& node) const;
+
+private:
+    std::vector<Node> _nodes;
+    // nodes of the current sequence, the last one is where it is
+    // empty once the sequence left the nodes kept
+    std::vector<uint32_t> _path;
+    size_t _numLeaves = 0; // distinct sequences run
+    size_t _numRuns = 0;
+
+    std::minstd_rand _rng;
+};
+
+#endif // __GOVERNOR_UNIFORM_H__